@@ -19,7 +19,9 @@
 
 #define MA_NODE_CONFIG_FILE             "/etc/sscma.conf"
 
+#if CONFIG_MA_ENGINE_HAILO
 #define MA_USE_ENGINE_HAILO             1
+#endif
 
 #define ma_malloc                       malloc
 #define ma_calloc                       calloc
@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <cstring>
+
+#include "ma_engine_cpu.h"
+
+#if CONFIG_MA_ENGINE_CPU
+
+namespace ma::engine {
+
+constexpr char TAG[] = "ma::engine::cpu";
+
+static ma_shape_t toShape(const cv::Mat& mat) {
+    ma_shape_t shape;
+    memset(&shape, 0, sizeof(shape));
+    shape.size = std::min(mat.dims, MA_ENGINE_SHAPE_MAX_DIM);
+    for (size_t i = 0; i < shape.size; i++) {
+        shape.dims[i] = mat.size[i];
+    }
+    return shape;
+}
+
+EngineCPU::EngineCPU(int32_t width, int32_t height) : width_(width), height_(height), loaded_(false) {
+    memset(&input_, 0, sizeof(input_));
+}
+
+EngineCPU::~EngineCPU() {}
+
+ma_err_t EngineCPU::init() {
+    return MA_OK;
+}
+
+ma_err_t EngineCPU::init(size_t size) {
+    return init();
+}
+
+ma_err_t EngineCPU::init(void* pool, size_t size) {
+    return init();
+}
+
+ma_err_t EngineCPU::load(const void* model_data, size_t model_size) {
+    MA_TRY {
+        std::vector<uchar> buffer(static_cast<const uchar*>(model_data), static_cast<const uchar*>(model_data) + model_size);
+        net_ = cv::dnn::readNetFromONNX(buffer);
+    }
+    MA_CATCH(cv::Exception & e) {
+        MA_LOGE(TAG, "load failed: %s", e.what());
+        return MA_EINVAL;
+    }
+    return prepare();
+}
+
+ma_err_t EngineCPU::load(const char* model_path) {
+    MA_TRY {
+        net_ = cv::dnn::readNet(model_path);
+    }
+    MA_CATCH(cv::Exception & e) {
+        MA_LOGE(TAG, "load failed: %s %s", model_path, e.what());
+        return MA_EINVAL;
+    }
+    return prepare();
+}
+
+ma_err_t EngineCPU::load(const std::string& model_path) {
+    return load(model_path.c_str());
+}
+
+ma_err_t EngineCPU::prepare() {
+    if (net_.empty()) {
+        return MA_EINVAL;
+    }
+
+    net_.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+    net_.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+    output_names_ = net_.getUnconnectedOutLayersNames();
+
+    // same input contract as the accelerator: one NHWC RGB uint8 image
+    input_buffer_.assign(static_cast<size_t>(width_) * height_ * 3, 0);
+    memset(&input_, 0, sizeof(input_));
+    input_.shape.size    = 4;
+    input_.shape.dims[0] = 1;
+    input_.shape.dims[1] = height_;
+    input_.shape.dims[2] = width_;
+    input_.shape.dims[3] = 3;
+    input_.type          = MA_TENSOR_TYPE_U8;
+    input_.size          = input_buffer_.size();
+    input_.index         = 0;
+    input_.name          = "input";
+    input_.is_physical   = false;
+    input_.is_variable   = true;
+    input_.data.data     = input_buffer_.data();
+    input_.quant_param   = {1.0f / 255.0f, 0};
+
+    // one warm up pass discovers the output shapes the model factory inspects
+    loaded_ = true;
+    if (run() != MA_OK) {
+        loaded_ = false;
+        return MA_EINVAL;
+    }
+
+    MA_LOGI(TAG, "loaded: %dx%d, %zu outputs", width_, height_, output_tensors_.size());
+    return MA_OK;
+}
+
+ma_err_t EngineCPU::run() {
+    if (!loaded_) {
+        return MA_EPERM;
+    }
+
+    MA_TRY {
+        cv::Mat image(height_, width_, CV_8UC3, input_buffer_.data());
+        cv::dnn::blobFromImage(image, blob_, 1.0 / 255.0, cv::Size(), cv::Scalar(), false, false, CV_32F);
+        net_.setInput(blob_);
+        net_.forward(outputs_, output_names_);
+    }
+    MA_CATCH(cv::Exception & e) {
+        MA_LOGE(TAG, "run failed: %s", e.what());
+        return MA_EIO;
+    }
+
+    // forward may hand back new buffers, refresh the views every run
+    output_tensors_.resize(outputs_.size());
+    for (size_t i = 0; i < outputs_.size(); i++) {
+        if (outputs_[i].depth() != CV_32F) {
+            outputs_[i].convertTo(outputs_[i], CV_32F);
+        }
+        ma_tensor_t& tensor = output_tensors_[i];
+        memset(&tensor, 0, sizeof(tensor));
+        tensor.shape       = toShape(outputs_[i]);
+        tensor.type        = MA_TENSOR_TYPE_F32;
+        tensor.size        = outputs_[i].total() * sizeof(float);
+        tensor.index       = static_cast<int32_t>(i);
+        tensor.name        = output_names_[i].c_str();
+        tensor.is_physical = false;
+        tensor.is_variable = true;
+        tensor.quant_param = {1.0f, 0};
+        tensor.data.data   = outputs_[i].data;
+    }
+
+    return MA_OK;
+}
+
+ma_err_t EngineCPU::setInput(int32_t index, const ma_tensor_t& tensor) {
+    if (index != 0 || tensor.data.data == nullptr) {
+        return MA_EINVAL;
+    }
+    if (tensor.data.data != input_buffer_.data()) {
+        memcpy(input_buffer_.data(), tensor.data.data, std::min(tensor.size, input_buffer_.size()));
+    }
+    return MA_OK;
+}
+
+ma_tensor_t EngineCPU::getInput(int32_t index) {
+    if (index != 0) {
+        ma_tensor_t tensor;
+        memset(&tensor, 0, sizeof(tensor));
+        return tensor;
+    }
+    return input_;
+}
+
+ma_tensor_t EngineCPU::getOutput(int32_t index) {
+    if (index < 0 || index >= static_cast<int32_t>(output_tensors_.size())) {
+        ma_tensor_t tensor;
+        memset(&tensor, 0, sizeof(tensor));
+        return tensor;
+    }
+    return output_tensors_[index];
+}
+
+ma_shape_t EngineCPU::getInputShape(int32_t index) {
+    return getInput(index).shape;
+}
+
+ma_shape_t EngineCPU::getOutputShape(int32_t index) {
+    return getOutput(index).shape;
+}
+
+ma_quant_param_t EngineCPU::getInputQuantParam(int32_t index) {
+    return getInput(index).quant_param;
+}
+
+ma_quant_param_t EngineCPU::getOutputQuantParam(int32_t index) {
+    return getOutput(index).quant_param;
+}
+
+int32_t EngineCPU::getInputSize() {
+    return loaded_ ? 1 : 0;
+}
+
+int32_t EngineCPU::getOutputSize() {
+    return static_cast<int32_t>(output_tensors_.size());
+}
+
+int32_t EngineCPU::getInputNum(const char* name) {
+    return name != nullptr && input_.name != nullptr && strcmp(name, input_.name) == 0 ? 0 : -1;
+}
+
+int32_t EngineCPU::getOutputNum(const char* name) {
+    for (size_t i = 0; i < output_names_.size(); i++) {
+        if (name != nullptr && output_names_[i] == name) {
+            return static_cast<int32_t>(i);
+        }
+    }
+    return -1;
+}
+
+}  // namespace ma::engine
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef _MA_ENGINE_CPU_H_
+#define _MA_ENGINE_CPU_H_
+
+#include "core/ma_common.h"
+
+#if CONFIG_MA_ENGINE_CPU
+
+#include <string>
+#include <vector>
+
+#include <opencv2/dnn.hpp>
+#include <opencv2/opencv.hpp>
+
+#include "core/engine/ma_engine_base.h"
+
+namespace ma::engine {
+
+// Reference engine running ONNX exports through OpenCV DNN on the CPU.
+// The input is exposed like the accelerator one (NHWC RGB uint8), outputs are float32 in the exported layout.
+class EngineCPU final : public Engine {
+public:
+    EngineCPU(int32_t width = 640, int32_t height = 640);
+    ~EngineCPU();
+
+    ma_err_t init() override;
+    ma_err_t init(size_t size) override;
+    ma_err_t init(void* pool, size_t size) override;
+
+    ma_err_t run() override;
+
+    ma_err_t load(const void* model_data, size_t model_size) override;
+    ma_err_t load(const char* model_path) override;
+    ma_err_t load(const std::string& model_path) override;
+
+    ma_err_t setInput(int32_t index, const ma_tensor_t& tensor) override;
+    ma_tensor_t getInput(int32_t index) override;
+    ma_tensor_t getOutput(int32_t index) override;
+    ma_shape_t getInputShape(int32_t index) override;
+    ma_shape_t getOutputShape(int32_t index) override;
+    ma_quant_param_t getInputQuantParam(int32_t index) override;
+    ma_quant_param_t getOutputQuantParam(int32_t index) override;
+
+    int32_t getInputSize() override;
+    int32_t getOutputSize() override;
+    int32_t getInputNum(const char* name) override;
+    int32_t getOutputNum(const char* name) override;
+
+private:
+    ma_err_t prepare();
+
+    int32_t width_;
+    int32_t height_;
+    bool loaded_;
+    cv::dnn::Net net_;
+    std::vector<std::string> output_names_;
+    std::vector<uint8_t> input_buffer_;
+    ma_tensor_t input_;
+    cv::Mat blob_;
+    std::vector<cv::Mat> outputs_;
+    std::vector<ma_tensor_t> output_tensors_;
+};
+
+}  // namespace ma::engine
+
+#endif
+
+#endif  // _MA_ENGINE_CPU_H_
@@ -0,0 +1,53 @@
+#include "ma_engine_factory.h"
+
+namespace ma::engine {
+
+constexpr char TAG[] = "ma::engine::factory";
+
+#define MA_ENGINE_CPU_INPUT_SIZE 640
+
+std::vector<std::string> EngineFactory::available() {
+    std::vector<std::string> types;
+#if CONFIG_MA_ENGINE_HAILO
+    types.push_back("hailo");
+#endif
+#if CONFIG_MA_ENGINE_CPU
+    types.push_back("cpu");
+#endif
+#if CONFIG_MA_ENGINE_MOCK
+    types.push_back("mock");
+#endif
+    return types;
+}
+
+Engine* EngineFactory::create(const std::string& type, int32_t width, int32_t height) {
+    std::string name = type;
+    if (name.empty()) {
+        auto types = available();
+        if (types.empty()) {
+            return nullptr;
+        }
+        name = types.front();
+    }
+
+#if CONFIG_MA_ENGINE_HAILO
+    if (name == "hailo") {
+        return new EngineHailo();
+    }
+#endif
+#if CONFIG_MA_ENGINE_CPU
+    if (name == "cpu") {
+        return new EngineCPU(width > 0 ? width : MA_ENGINE_CPU_INPUT_SIZE, height > 0 ? height : MA_ENGINE_CPU_INPUT_SIZE);
+    }
+#endif
+#if CONFIG_MA_ENGINE_MOCK
+    if (name == "mock") {
+        return new EngineMock();
+    }
+#endif
+
+    MA_LOGE(TAG, "engine not available: %s", name.c_str());
+    return nullptr;
+}
+
+}  // namespace ma::engine
@@ -0,0 +1,26 @@
+#ifndef _MA_ENGINE_FACTORY_H_
+#define _MA_ENGINE_FACTORY_H_
+
+#include <string>
+#include <vector>
+
+#include "core/ma_core.h"
+
+#include "ma_engine_cpu.h"
+#include "ma_engine_mock.h"
+
+namespace ma::engine {
+
+// Picks an engine backend at run time, the set of backends is fixed at build time (CONFIG_MA_ENGINE_*).
+class EngineFactory {
+public:
+    // "hailo", "cpu" or "mock", empty picks the first one built in; nullptr when not available
+    // width and height size the input of the cpu engine, 0 keeps the default
+    static Engine* create(const std::string& type, int32_t width = 0, int32_t height = 0);
+
+    static std::vector<std::string> available();
+};
+
+}  // namespace ma::engine
+
+#endif  // _MA_ENGINE_FACTORY_H_
@@ -0,0 +1,268 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <cJSON.h>
+
+#include "ma_engine_mock.h"
+
+#if CONFIG_MA_ENGINE_MOCK
+
+#include "porting/ma_osal.h"
+
+namespace ma::engine {
+
+constexpr char TAG[] = "ma::engine::mock";
+
+static ma_tensor_type_t parseType(const char* type, size_t& element) {
+    static const struct {
+        const char* name;
+        ma_tensor_type_t type;
+        size_t size;
+    } types[] = {
+        {"u8", MA_TENSOR_TYPE_U8, 1},
+        {"s8", MA_TENSOR_TYPE_S8, 1},
+        {"u16", MA_TENSOR_TYPE_U16, 2},
+        {"s16", MA_TENSOR_TYPE_S16, 2},
+        {"u32", MA_TENSOR_TYPE_U32, 4},
+        {"s32", MA_TENSOR_TYPE_S32, 4},
+        {"f16", MA_TENSOR_TYPE_F16, 2},
+        {"f32", MA_TENSOR_TYPE_F32, 4},
+    };
+    for (auto& t : types) {
+        if (type != nullptr && strcmp(type, t.name) == 0) {
+            element = t.size;
+            return t.type;
+        }
+    }
+    element = 4;
+    return MA_TENSOR_TYPE_F32;
+}
+
+static ma_tensor_t emptyTensor() {
+    ma_tensor_t tensor;
+    memset(&tensor, 0, sizeof(tensor));
+    return tensor;
+}
+
+EngineMock::EngineMock() : latency_(0), latency_fixed_(false) {}
+
+EngineMock::~EngineMock() {}
+
+ma_err_t EngineMock::init() {
+    return MA_OK;
+}
+
+ma_err_t EngineMock::init(size_t size) {
+    return init();
+}
+
+ma_err_t EngineMock::init(void* pool, size_t size) {
+    return init();
+}
+
+void EngineMock::setLatency(uint32_t latency) {
+    latency_       = latency;
+    latency_fixed_ = true;
+}
+
+ma_err_t EngineMock::load(const void* model_data, size_t model_size) {
+    std::string description(static_cast<const char*>(model_data), model_size);
+    return parse(description.c_str(), "");
+}
+
+ma_err_t EngineMock::load(const char* model_path) {
+    std::ifstream file(model_path);
+    if (!file.is_open()) {
+        MA_LOGE(TAG, "open failed: %s", model_path);
+        return MA_ENOENT;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    std::string base(model_path);
+    size_t pos = base.find_last_of('/');
+    base       = pos == std::string::npos ? "" : base.substr(0, pos + 1);
+
+    return parse(buffer.str().c_str(), base);
+}
+
+ma_err_t EngineMock::load(const std::string& model_path) {
+    return load(model_path.c_str());
+}
+
+ma_err_t EngineMock::parse(const char* description, const std::string& base) {
+    cJSON* root = cJSON_Parse(description);
+    if (root == nullptr) {
+        MA_LOGE(TAG, "invalid description");
+        return MA_EINVAL;
+    }
+
+    inputs_.clear();
+    outputs_.clear();
+
+    cJSON* latency = cJSON_GetObjectItem(root, "latency");
+    if (!latency_fixed_ && cJSON_IsNumber(latency)) {
+        latency_ = static_cast<uint32_t>(latency->valuedouble);
+    }
+
+    auto build = [&base](cJSON* item, int32_t index, Tensor& out) -> bool {
+        cJSON* shape = cJSON_GetObjectItem(item, "shape");
+        if (!cJSON_IsArray(shape) || cJSON_GetArraySize(shape) > MA_ENGINE_SHAPE_MAX_DIM) {
+            return false;
+        }
+
+        size_t element = 0;
+        cJSON* type    = cJSON_GetObjectItem(item, "type");
+        cJSON* name    = cJSON_GetObjectItem(item, "name");
+        cJSON* scale   = cJSON_GetObjectItem(item, "scale");
+        cJSON* zero    = cJSON_GetObjectItem(item, "zero_point");
+        cJSON* file    = cJSON_GetObjectItem(item, "file");
+
+        memset(&out.tensor, 0, sizeof(out.tensor));
+        out.tensor.type = parseType(cJSON_IsString(type) ? type->valuestring : nullptr, element);
+
+        size_t count = 1;
+        for (int i = 0; i < cJSON_GetArraySize(shape); i++) {
+            out.tensor.shape.dims[i] = cJSON_GetArrayItem(shape, i)->valueint;
+            count *= std::max(out.tensor.shape.dims[i], 1);
+        }
+        out.tensor.shape.size = cJSON_GetArraySize(shape);
+
+        out.name = cJSON_IsString(name) ? name->valuestring : "tensor" + std::to_string(index);
+        out.data.assign(count * element, 0);
+
+        if (cJSON_IsString(file)) {
+            std::string path = file->valuestring[0] == '/' ? file->valuestring : base + file->valuestring;
+            std::ifstream payload(path, std::ios::binary);
+            if (!payload.is_open()) {
+                MA_LOGW(TAG, "payload not found, zero filled: %s", path.c_str());
+            } else {
+                payload.read(reinterpret_cast<char*>(out.data.data()), out.data.size());
+            }
+        }
+
+        out.tensor.quant_param.scale      = cJSON_IsNumber(scale) ? static_cast<float>(scale->valuedouble) : 1.0f;
+        out.tensor.quant_param.zero_point = cJSON_IsNumber(zero) ? zero->valueint : 0;
+        out.tensor.size                   = out.data.size();
+        out.tensor.index                  = index;
+        out.tensor.is_physical            = false;
+        out.tensor.is_variable            = true;
+        return true;
+    };
+
+    bool ok      = true;
+    cJSON* input = cJSON_GetObjectItem(root, "input");
+    if (cJSON_IsObject(input)) {
+        inputs_.emplace_back();
+        ok = build(input, 0, inputs_.back());
+    }
+    cJSON* outputs = cJSON_GetObjectItem(root, "outputs");
+    for (int i = 0; ok && cJSON_IsArray(outputs) && i < cJSON_GetArraySize(outputs); i++) {
+        outputs_.emplace_back();
+        ok = build(cJSON_GetArrayItem(outputs, i), i, outputs_.back());
+    }
+
+    cJSON_Delete(root);
+
+    if (!ok || inputs_.empty() || outputs_.empty()) {
+        MA_LOGE(TAG, "description needs an input and at least one output");
+        inputs_.clear();
+        outputs_.clear();
+        return MA_EINVAL;
+    }
+
+    // names and data live in the vectors now, point the tensors at them
+    for (auto* tensors : {&inputs_, &outputs_}) {
+        for (auto& t : *tensors) {
+            t.tensor.name      = t.name.c_str();
+            t.tensor.data.data = t.data.data();
+        }
+    }
+
+    MA_LOGI(TAG, "loaded: %zu outputs, latency %ums", outputs_.size(), latency_);
+    return MA_OK;
+}
+
+ma_err_t EngineMock::run() {
+    if (outputs_.empty()) {
+        return MA_EPERM;
+    }
+    // outputs never change, only the time spent is simulated
+    if (latency_ > 0) {
+        Thread::sleep(Tick::fromMilliseconds(latency_));
+    }
+    return MA_OK;
+}
+
+ma_err_t EngineMock::setInput(int32_t index, const ma_tensor_t& tensor) {
+    if (index < 0 || index >= static_cast<int32_t>(inputs_.size()) || tensor.data.data == nullptr) {
+        return MA_EINVAL;
+    }
+    Tensor& input = inputs_[index];
+    if (tensor.data.data != input.data.data()) {
+        memcpy(input.data.data(), tensor.data.data, std::min(tensor.size, input.data.size()));
+    }
+    return MA_OK;
+}
+
+ma_tensor_t EngineMock::getInput(int32_t index) {
+    if (index < 0 || index >= static_cast<int32_t>(inputs_.size())) {
+        return emptyTensor();
+    }
+    return inputs_[index].tensor;
+}
+
+ma_tensor_t EngineMock::getOutput(int32_t index) {
+    if (index < 0 || index >= static_cast<int32_t>(outputs_.size())) {
+        return emptyTensor();
+    }
+    return outputs_[index].tensor;
+}
+
+ma_shape_t EngineMock::getInputShape(int32_t index) {
+    return getInput(index).shape;
+}
+
+ma_shape_t EngineMock::getOutputShape(int32_t index) {
+    return getOutput(index).shape;
+}
+
+ma_quant_param_t EngineMock::getInputQuantParam(int32_t index) {
+    return getInput(index).quant_param;
+}
+
+ma_quant_param_t EngineMock::getOutputQuantParam(int32_t index) {
+    return getOutput(index).quant_param;
+}
+
+int32_t EngineMock::getInputSize() {
+    return static_cast<int32_t>(inputs_.size());
+}
+
+int32_t EngineMock::getOutputSize() {
+    return static_cast<int32_t>(outputs_.size());
+}
+
+int32_t EngineMock::getInputNum(const char* name) {
+    for (size_t i = 0; name != nullptr && i < inputs_.size(); i++) {
+        if (inputs_[i].name == name) {
+            return static_cast<int32_t>(i);
+        }
+    }
+    return -1;
+}
+
+int32_t EngineMock::getOutputNum(const char* name) {
+    for (size_t i = 0; name != nullptr && i < outputs_.size(); i++) {
+        if (outputs_[i].name == name) {
+            return static_cast<int32_t>(i);
+        }
+    }
+    return -1;
+}
+
+}  // namespace ma::engine
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef _MA_ENGINE_MOCK_H_
+#define _MA_ENGINE_MOCK_H_
+
+#include "core/ma_common.h"
+
+#if CONFIG_MA_ENGINE_MOCK
+
+#include <string>
+#include <vector>
+
+#include "core/engine/ma_engine_base.h"
+
+namespace ma::engine {
+
+// Deterministic stand-in for an accelerator, replays canned output tensors after a fixed latency.
+// The model is a JSON description, tensor payloads are raw files next to it (zero filled when absent):
+// {"latency": 20, "input": {"shape": [1, 640, 640, 3], "type": "u8"},
+//  "outputs": [{"name": "out0", "shape": [1, 84, 8400], "type": "f32", "scale": 1.0, "zero_point": 0, "file": "out0.bin"}]}
+class EngineMock final : public Engine {
+public:
+    EngineMock();
+    ~EngineMock();
+
+    ma_err_t init() override;
+    ma_err_t init(size_t size) override;
+    ma_err_t init(void* pool, size_t size) override;
+
+    ma_err_t run() override;
+
+    ma_err_t load(const void* model_data, size_t model_size) override;
+    ma_err_t load(const char* model_path) override;
+    ma_err_t load(const std::string& model_path) override;
+
+    ma_err_t setInput(int32_t index, const ma_tensor_t& tensor) override;
+    ma_tensor_t getInput(int32_t index) override;
+    ma_tensor_t getOutput(int32_t index) override;
+    ma_shape_t getInputShape(int32_t index) override;
+    ma_shape_t getOutputShape(int32_t index) override;
+    ma_quant_param_t getInputQuantParam(int32_t index) override;
+    ma_quant_param_t getOutputQuantParam(int32_t index) override;
+
+    int32_t getInputSize() override;
+    int32_t getOutputSize() override;
+    int32_t getInputNum(const char* name) override;
+    int32_t getOutputNum(const char* name) override;
+
+    // overrides the latency of the description, in milliseconds
+    void setLatency(uint32_t latency);
+
+private:
+    struct Tensor {
+        std::string name;
+        std::vector<uint8_t> data;
+        ma_tensor_t tensor;
+    };
+
+    ma_err_t parse(const char* description, const std::string& base);
+
+    uint32_t latency_;
+    bool latency_fixed_;
+    std::vector<Tensor> inputs_;
+    std::vector<Tensor> outputs_;
+};
+
+}  // namespace ma::engine
+
+#endif
+
+#endif  // _MA_ENGINE_MOCK_H_
@@ -0,0 +1,140 @@
+#include <chrono>
+#include <stdio.h>
+
+#include <cJSON.h>
+
+#include "common.h"
+
+#define TAG "benchmark"
+
+namespace {
+
+struct Stage {
+    const char* name;
+    LatencyStats stats;
+};
+
+double elapsed(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+// Keeps the engine loaded and runs every input through the model, after warmup untimed runs of the first one.
+// decode and letterbox are measured here, preprocess/inference/postprocess come from model->getPerf().
+int runBenchmark(ma::Model* model, const std::string& input, int warmup, int repeat, const std::string& report) {
+    InputReader reader;
+    if (!reader.open(input)) {
+        return 1;
+    }
+
+    enum { DECODE = 0, LETTERBOX, PREPROCESS, INFERENCE, POSTPROCESS, TOTAL, STAGES };
+    Stage stages[STAGES] = {{"decode", {}}, {"letterbox", {}}, {"preprocess", {}}, {"inference", {}}, {"postprocess", {}}, {"total", {}}};
+
+    cv::Mat image;
+    size_t errors = 0;
+    int runs      = 0;
+
+    // extra runs on the first input, every input is still measured afterwards
+    if (warmup > 0) {
+        if (!reader.next(image)) {
+            MA_LOGE(TAG, "no input to warm up on: %s", input.c_str());
+            return 1;
+        }
+        cv::Mat first = preprocessImage(image, model);
+        ma_img_t img  = toImage(first);
+        for (int i = 0; i < warmup; i++) {
+            runModel(model, &img);
+        }
+    }
+
+    auto bench_start = std::chrono::steady_clock::now();
+
+    for (int pass = 0; pass < std::max(repeat, 1); pass++) {
+        reader.rewind();
+        while (true) {
+            auto start = std::chrono::steady_clock::now();
+            if (!reader.next(image)) {
+                break;
+            }
+            double decode = elapsed(start);
+
+            auto letterbox_start = std::chrono::steady_clock::now();
+            cv::Mat input        = preprocessImage(image, model);
+            double letterbox     = elapsed(letterbox_start);
+
+            ma_img_t img = toImage(input);
+            ma_err_t err = runModel(model, &img);
+            double total = elapsed(start);
+
+            runs++;
+            if (err != MA_OK) {
+                errors++;
+                continue;
+            }
+
+            auto perf = model->getPerf();
+            stages[DECODE].stats.add(decode);
+            stages[LETTERBOX].stats.add(letterbox);
+            stages[PREPROCESS].stats.add(perf.preprocess);
+            stages[INFERENCE].stats.add(perf.inference);
+            stages[POSTPROCESS].stats.add(perf.postprocess);
+            stages[TOTAL].stats.add(total);
+        }
+    }
+
+    double wall     = elapsed(bench_start);
+    size_t measured = stages[TOTAL].stats.samples.size();
+    double fps      = wall > 0 ? measured * 1000.0 / wall : 0.0;
+
+    if (measured == 0) {
+        MA_LOGE(TAG, "nothing measured: %d runs, %zu errors", runs, errors);
+        return 1;
+    }
+
+    printf("\n%-12s %10s %10s %10s %10s %10s\n", "stage(ms)", "mean", "p50", "p90", "p99", "max");
+    for (auto& stage : stages) {
+        printf("%-12s %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+               stage.name,
+               stage.stats.mean(),
+               stage.stats.percentile(50),
+               stage.stats.percentile(90),
+               stage.stats.percentile(99),
+               stage.stats.percentile(100));
+    }
+    printf("\nimages: %zu, warmup: %d, errors: %zu, wall: %.1fms, throughput: %.2f img/s\n", measured, warmup, errors, wall, fps);
+
+    if (!report.empty()) {
+        cJSON* root = cJSON_CreateObject();
+        cJSON_AddStringToObject(root, "model", model->getName());
+        cJSON_AddStringToObject(root, "input", input.c_str());
+        cJSON_AddNumberToObject(root, "images", measured);
+        cJSON_AddNumberToObject(root, "warmup", warmup);
+        cJSON_AddNumberToObject(root, "errors", errors);
+        cJSON_AddNumberToObject(root, "wall_ms", wall);
+        cJSON_AddNumberToObject(root, "throughput", fps);
+        cJSON* latency = cJSON_AddObjectToObject(root, "latency_ms");
+        for (auto& stage : stages) {
+            cJSON* item = cJSON_AddObjectToObject(latency, stage.name);
+            cJSON_AddNumberToObject(item, "mean", stage.stats.mean());
+            cJSON_AddNumberToObject(item, "p50", stage.stats.percentile(50));
+            cJSON_AddNumberToObject(item, "p90", stage.stats.percentile(90));
+            cJSON_AddNumberToObject(item, "p99", stage.stats.percentile(99));
+            cJSON_AddNumberToObject(item, "max", stage.stats.percentile(100));
+        }
+
+        char* text = cJSON_Print(root);
+        FILE* file = fopen(report.c_str(), "w");
+        if (file != nullptr) {
+            fputs(text, file);
+            fclose(file);
+            MA_LOGI(TAG, "report: %s", report.c_str());
+        } else {
+            MA_LOGE(TAG, "write failed: %s", report.c_str());
+        }
+        cJSON_free(text);
+        cJSON_Delete(root);
+    }
+
+    return errors == 0 ? 0 : 1;
+}
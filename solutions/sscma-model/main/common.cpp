@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <numeric>
+
+#include "common.h"
+
+#define TAG "common"
+
+ma_img_t toImage(cv::Mat& image) {
+    ma_img_t img;
+    img.data     = (uint8_t*)image.data;
+    img.size     = image.rows * image.cols * image.channels();
+    img.width    = image.cols;
+    img.height   = image.rows;
+    img.format   = MA_PIXEL_FORMAT_RGB888;
+    img.rotate   = MA_PIXEL_ROTATE_0;
+    img.physical = false;
+    return img;
+}
+
+ma_err_t runModel(ma::Model* model, ma_img_t* img) {
+    switch (model->getOutputType()) {
+        case MA_OUTPUT_TYPE_CLASS:
+            return static_cast<ma::model::Classifier*>(model)->run(img);
+        case MA_OUTPUT_TYPE_KEYPOINT:
+            return static_cast<ma::model::PoseDetector*>(model)->run(img);
+        case MA_OUTPUT_TYPE_SEGMENT:
+            return static_cast<ma::model::Segmentor*>(model)->run(img);
+        case MA_OUTPUT_TYPE_BBOX:
+            return static_cast<ma::model::Detector*>(model)->run(img);
+        default:
+            return MA_ENOTSUP;
+    }
+}
+
+void collectResults(ma::Model* model, Results& results) {
+    results.type = model->getOutputType();
+    results.boxes.clear();
+    results.classes.clear();
+    results.keypoints.clear();
+    results.segments.clear();
+
+    switch (results.type) {
+        case MA_OUTPUT_TYPE_CLASS: {
+            auto& _results = static_cast<ma::model::Classifier*>(model)->getResults();
+            results.classes.assign(_results.begin(), _results.end());
+            break;
+        }
+        case MA_OUTPUT_TYPE_KEYPOINT: {
+            auto& _results = static_cast<ma::model::PoseDetector*>(model)->getResults();
+            results.keypoints.assign(_results.begin(), _results.end());
+            break;
+        }
+        case MA_OUTPUT_TYPE_SEGMENT: {
+            auto& _results = static_cast<ma::model::Segmentor*>(model)->getResults();
+            results.segments.assign(_results.begin(), _results.end());
+            break;
+        }
+        case MA_OUTPUT_TYPE_BBOX: {
+            auto& _results = static_cast<ma::model::Detector*>(model)->getResults();
+            results.boxes.assign(_results.begin(), _results.end());
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static bool isImageFile(const std::string& path) {
+    static const std::vector<std::string> extensions = {".jpg", ".jpeg", ".png", ".bmp"};
+
+    size_t pos = path.find_last_of('.');
+    if (pos == std::string::npos) {
+        return false;
+    }
+    std::string ext = path.substr(pos);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return std::find(extensions.begin(), extensions.end(), ext) != extensions.end();
+}
+
+bool InputReader::open(const std::string& input) {
+    input_ = input;
+    video_ = false;
+    index_ = 0;
+    files_.clear();
+
+    std::vector<std::string> found;
+    if (input.find_first_of("*?") != std::string::npos) {
+        cv::glob(input, found, false);
+    } else if (isImageFile(input)) {
+        found.push_back(input);
+    } else if (std::filesystem::is_directory(input)) {
+        cv::glob(input + "/*", found, false);
+    } else {
+        video_ = capture_.open(input);
+        if (!video_) {
+            MA_LOGE(TAG, "open failed: %s", input.c_str());
+        }
+        return video_;
+    }
+
+    for (auto& file : found) {
+        if (isImageFile(file)) {
+            files_.push_back(file);
+        }
+    }
+    std::sort(files_.begin(), files_.end());
+
+    if (files_.empty()) {
+        MA_LOGE(TAG, "no images: %s", input.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool InputReader::next(cv::Mat& image, std::string* name) {
+    if (video_) {
+        if (name != nullptr) {
+            *name = input_ + "#" + std::to_string(index_);
+        }
+        index_++;
+        return capture_.read(image);
+    }
+
+    while (index_ < files_.size()) {
+        const std::string& file = files_[index_++];
+        image                   = cv::imread(file);
+        if (!image.empty()) {
+            if (name != nullptr) {
+                *name = file;
+            }
+            return true;
+        }
+        MA_LOGW(TAG, "read failed: %s", file.c_str());
+    }
+    return false;
+}
+
+void InputReader::rewind() {
+    index_ = 0;
+    if (video_) {
+        capture_.set(cv::CAP_PROP_POS_FRAMES, 0);
+    }
+}
+
+double LatencyStats::mean() const {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    return std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+}
+
+double LatencyStats::percentile(double p) const {
+    if (samples.empty()) {
+        return 0.0;
+    }
+    // nearest rank
+    std::vector<double> sorted(samples);
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    rank        = std::min(std::max<size_t>(rank, 1), sorted.size()) - 1;
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    return sorted[rank];
+}
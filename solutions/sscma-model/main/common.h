@@ -0,0 +1,96 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include <sscma.h>
+
+class ColorPalette {
+public:
+    static std::vector<cv::Scalar> getPalette() {
+        return palette;
+    }
+
+    static cv::Scalar getColor(int index) {
+        return palette[index % palette.size()];
+    }
+
+private:
+    static const std::vector<cv::Scalar> palette;
+};
+
+// letterboxed RGB model input
+cv::Mat preprocessImage(cv::Mat& image, ma::Model* model);
+
+// bit-packed mask (lsb first) blended inside the instance box
+void drawMaskOnImage(int cls, cv::Mat& targetImage, const std::vector<uint8_t>& maskData, int maskWidth, int maskHeight, const ma_bbox_t& box, double alpha = 0.5);
+
+// wraps a continuous RGB image without copying
+ma_img_t toImage(cv::Mat& image);
+
+// runs whichever task the model implements, results stay in the model
+ma_err_t runModel(ma::Model* model, ma_img_t* img);
+
+// copy of the results of the last run, the model reuses its storage on the next one
+struct Results {
+    ma_output_type_t type;
+    std::vector<ma_bbox_t> boxes;
+    std::vector<ma_class_t> classes;
+    std::vector<ma_keypoint3f_t> keypoints;
+    std::vector<ma_segm2f_t> segments;
+};
+
+void collectResults(ma::Model* model, Results& results);
+
+// boxes, labels, keypoints and masks on the letterboxed RGB image, verbose also prints them
+void drawResults(cv::Mat& image, const Results& results, bool verbose = false);
+
+// a single image, a directory, a glob pattern or a video file, read frame by frame
+class InputReader {
+public:
+    bool open(const std::string& input);
+    bool next(cv::Mat& image, std::string* name = nullptr);
+    void rewind();
+
+    const std::vector<std::string>& files() const {
+        return files_;
+    }
+
+    bool isVideo() const {
+        return video_;
+    }
+
+private:
+    std::string input_;
+    bool video_ = false;
+    std::vector<std::string> files_;
+    size_t index_ = 0;
+    cv::VideoCapture capture_;
+};
+
+// latency samples in milliseconds
+struct LatencyStats {
+    std::vector<double> samples;
+
+    void add(double ms) {
+        samples.push_back(ms);
+    }
+    double mean() const;
+    double percentile(double p) const;
+};
+
+int runPipeline(ma::Model* model, const std::string& input, const std::string& output, int workers, int writers, int depth);
+
+int runEval(ma::Model* model,
+            const std::string& annotations,
+            const std::string& images,
+            const std::vector<float>& tscores,
+            const std::vector<float>& tious,
+            int threads,
+            const std::string& report);
+
+int runBenchmark(ma::Model* model, const std::string& input, int warmup, int repeat, const std::string& report);
+
+int runMaskBenchmark(int iterations, int instances);
@@ -0,0 +1,386 @@
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <numeric>
+#include <sstream>
+#include <stdio.h>
+#include <thread>
+
+#include <cJSON.h>
+
+#include "common.h"
+
+#define TAG "eval"
+
+// COCO keeps the 100 best detections per image and category
+#define EVAL_MAX_DETECTIONS 100
+
+// mAP@0.5:0.95 averages over these IoU thresholds
+#define EVAL_IOU_STEPS 10
+
+namespace {
+
+struct Box {
+    float x;  // top left, source image pixels
+    float y;
+    float w;
+    float h;
+    int category;
+    float score;
+    bool crowd;
+};
+
+struct Sample {
+    int id;
+    std::string file;
+    std::vector<Box> truths;
+    std::vector<Box> detections;
+};
+
+// (score, true positive) per detection that was not ignored
+typedef std::vector<std::pair<float, bool>> Matches;
+
+float iou(const Box& a, const Box& b, bool crowd) {
+    float x1    = std::max(a.x, b.x);
+    float y1    = std::max(a.y, b.y);
+    float x2    = std::min(a.x + a.w, b.x + b.w);
+    float y2    = std::min(a.y + a.h, b.y + b.h);
+    float inter = std::max(0.0f, x2 - x1) * std::max(0.0f, y2 - y1);
+    // crowd regions count the overlap against the detection only, like pycocotools
+    float area = crowd ? a.w * a.h : a.w * a.h + b.w * b.h - inter;
+    return area > 0 ? inter / area : 0.0f;
+}
+
+bool loadAnnotations(const std::string& path, std::vector<Sample>& samples, std::vector<int>& categories) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        MA_LOGE(TAG, "open failed: %s", path.c_str());
+        return false;
+    }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+
+    cJSON* root = cJSON_Parse(buffer.str().c_str());
+    if (root == nullptr) {
+        MA_LOGE(TAG, "invalid annotations: %s", path.c_str());
+        return false;
+    }
+
+    std::map<int, size_t> index;
+    cJSON* images = cJSON_GetObjectItem(root, "images");
+    for (int i = 0; cJSON_IsArray(images) && i < cJSON_GetArraySize(images); i++) {
+        cJSON* image = cJSON_GetArrayItem(images, i);
+        cJSON* id    = cJSON_GetObjectItem(image, "id");
+        cJSON* name  = cJSON_GetObjectItem(image, "file_name");
+        if (!cJSON_IsNumber(id) || !cJSON_IsString(name)) {
+            continue;
+        }
+        index[id->valueint] = samples.size();
+        samples.push_back({id->valueint, name->valuestring, {}, {}});
+    }
+
+    cJSON* annotations = cJSON_GetObjectItem(root, "annotations");
+    for (int i = 0; cJSON_IsArray(annotations) && i < cJSON_GetArraySize(annotations); i++) {
+        cJSON* annotation = cJSON_GetArrayItem(annotations, i);
+        cJSON* image      = cJSON_GetObjectItem(annotation, "image_id");
+        cJSON* category   = cJSON_GetObjectItem(annotation, "category_id");
+        cJSON* bbox       = cJSON_GetObjectItem(annotation, "bbox");
+        cJSON* crowd      = cJSON_GetObjectItem(annotation, "iscrowd");
+        if (!cJSON_IsNumber(image) || !cJSON_IsNumber(category) || !cJSON_IsArray(bbox) || cJSON_GetArraySize(bbox) != 4) {
+            continue;
+        }
+        auto it = index.find(image->valueint);
+        if (it == index.end()) {
+            continue;
+        }
+        Box box;
+        box.x        = cJSON_GetArrayItem(bbox, 0)->valuedouble;
+        box.y        = cJSON_GetArrayItem(bbox, 1)->valuedouble;
+        box.w        = cJSON_GetArrayItem(bbox, 2)->valuedouble;
+        box.h        = cJSON_GetArrayItem(bbox, 3)->valuedouble;
+        box.category = category->valueint;
+        box.score    = 1.0f;
+        box.crowd    = cJSON_IsNumber(crowd) && crowd->valueint != 0;
+        samples[it->second].truths.push_back(box);
+    }
+
+    // model class i is the i-th category in id order, the usual export convention
+    cJSON* list = cJSON_GetObjectItem(root, "categories");
+    for (int i = 0; cJSON_IsArray(list) && i < cJSON_GetArraySize(list); i++) {
+        cJSON* id = cJSON_GetObjectItem(cJSON_GetArrayItem(list, i), "id");
+        if (cJSON_IsNumber(id)) {
+            categories.push_back(id->valueint);
+        }
+    }
+    std::sort(categories.begin(), categories.end());
+
+    cJSON_Delete(root);
+    return !samples.empty() && !categories.empty();
+}
+
+// greedy matching of one image at one IoU threshold, best scores first, as pycocotools does
+void matchImage(const Sample& sample, float threshold, std::map<int, Matches>& matches) {
+    std::vector<const Box*> detections;
+    for (auto& detection : sample.detections) {
+        detections.push_back(&detection);
+    }
+    std::stable_sort(detections.begin(), detections.end(), [](const Box* a, const Box* b) { return a->score > b->score; });
+
+    // regular truths are tried before crowd regions
+    std::vector<size_t> order(sample.truths.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_partition(order.begin(), order.end(), [&sample](size_t i) { return !sample.truths[i].crowd; });
+
+    std::vector<bool> used(sample.truths.size(), false);
+    std::map<int, size_t> kept;
+    for (auto* detection : detections) {
+        if (kept[detection->category]++ >= EVAL_MAX_DETECTIONS) {
+            continue;
+        }
+
+        int best       = -1;
+        float best_iou = std::min(threshold, 1.0f - 1e-6f);
+        for (size_t i : order) {
+            const Box& truth = sample.truths[i];
+            if (truth.category != detection->category || (used[i] && !truth.crowd)) {
+                continue;
+            }
+            if (best >= 0 && !sample.truths[best].crowd && truth.crowd) {
+                break;
+            }
+            float overlap = iou(*detection, truth, truth.crowd);
+            if (overlap < best_iou) {
+                continue;
+            }
+            best     = static_cast<int>(i);
+            best_iou = overlap;
+        }
+
+        if (best >= 0 && sample.truths[best].crowd) {
+            continue;  // inside a crowd region, neither true nor false positive
+        }
+        if (best >= 0) {
+            used[best] = true;
+        }
+        matches[detection->category].emplace_back(detection->score, best >= 0);
+    }
+}
+
+// 101 point interpolated average precision
+double averagePrecision(Matches& matches, size_t truths) {
+    if (truths == 0) {
+        return 0.0;
+    }
+    std::sort(matches.begin(), matches.end(), [](const std::pair<float, bool>& a, const std::pair<float, bool>& b) { return a.first > b.first; });
+
+    std::vector<double> precision(matches.size());
+    std::vector<double> recall(matches.size());
+    size_t tp = 0;
+    for (size_t i = 0; i < matches.size(); i++) {
+        tp += matches[i].second ? 1 : 0;
+        precision[i] = static_cast<double>(tp) / (i + 1);
+        recall[i]    = static_cast<double>(tp) / truths;
+    }
+    for (size_t i = matches.size(); i-- > 1;) {
+        precision[i - 1] = std::max(precision[i - 1], precision[i]);
+    }
+
+    double sum = 0.0;
+    size_t k   = 0;
+    for (int r = 0; r <= 100; r++) {
+        double target = r / 100.0;
+        while (k < recall.size() && recall[k] < target) {
+            k++;
+        }
+        sum += k < precision.size() ? precision[k] : 0.0;
+    }
+    return sum / 101.0;
+}
+
+// matching is independent per image, spread it over the threads and merge per category
+void evaluate(const std::vector<Sample>& samples, int threads, double& map50, double& map5095) {
+    std::map<int, size_t> truths;
+    for (auto& sample : samples) {
+        for (auto& truth : sample.truths) {
+            if (!truth.crowd) {
+                truths[truth.category]++;
+            }
+        }
+    }
+
+    map50   = 0.0;
+    map5095 = 0.0;
+    if (truths.empty()) {
+        return;
+    }
+
+    threads = std::max(threads, 1);
+    for (int step = 0; step < EVAL_IOU_STEPS; step++) {
+        const float threshold = 0.5f + 0.05f * step;
+
+        std::vector<std::map<int, Matches>> partial(threads);
+        std::vector<std::thread> pool;
+        for (int t = 0; t < threads; t++) {
+            pool.emplace_back([&, t] {
+                for (size_t i = t; i < samples.size(); i += threads) {
+                    matchImage(samples[i], threshold, partial[t]);
+                }
+            });
+        }
+        for (auto& thread : pool) {
+            thread.join();
+        }
+
+        double sum = 0.0;
+        for (auto& category : truths) {
+            Matches merged;
+            for (auto& part : partial) {
+                auto it = part.find(category.first);
+                if (it != part.end()) {
+                    merged.insert(merged.end(), it->second.begin(), it->second.end());
+                }
+            }
+            sum += averagePrecision(merged, category.second);
+        }
+        double ap = sum / truths.size();
+
+        if (step == 0) {
+            map50 = ap;
+        }
+        map5095 += ap / EVAL_IOU_STEPS;
+    }
+}
+
+// normalized cx, cy, w, h on the letterboxed input -> top left x, y, w, h in source pixels
+Box toSource(const ma_bbox_t& bbox, int iw, int ih, int ow, int oh, const std::vector<int>& categories) {
+    double scale = std::min((double)oh / ih, (double)ow / iw);
+    int left     = (ow - (int)(iw * scale)) / 2;
+    int top      = (oh - (int)(ih * scale)) / 2;
+
+    Box box;
+    box.w        = bbox.w * ow / scale;
+    box.h        = bbox.h * oh / scale;
+    box.x        = (bbox.x * ow - left) / scale - box.w / 2;
+    box.y        = (bbox.y * oh - top) / scale - box.h / 2;
+    box.score    = bbox.score;
+    box.category = bbox.target >= 0 && bbox.target < static_cast<int>(categories.size()) ? categories[bbox.target] : -1;
+    box.crowd    = false;
+    return box;
+}
+
+}  // namespace
+
+// Runs the whole annotated set once per (tscore, tiou) point, boxes of pose and segment models are scored as detections.
+int runEval(ma::Model* model,
+            const std::string& annotations,
+            const std::string& images,
+            const std::vector<float>& tscores,
+            const std::vector<float>& tious,
+            int threads,
+            const std::string& report) {
+    if (model->getOutputType() == MA_OUTPUT_TYPE_CLASS) {
+        MA_LOGE(TAG, "classification models have no boxes to evaluate");
+        return 1;
+    }
+
+    std::vector<Sample> samples;
+    std::vector<int> categories;
+    if (!loadAnnotations(annotations, samples, categories)) {
+        return 1;
+    }
+    MA_LOGI(TAG, "annotations: %zu images, %zu categories", samples.size(), categories.size());
+
+    const int ow = reinterpret_cast<const ma_img_t*>(model->getInput())->width;
+    const int oh = reinterpret_cast<const ma_img_t*>(model->getInput())->height;
+
+    cJSON* root   = cJSON_CreateObject();
+    cJSON* points = cJSON_AddArrayToObject(root, "sweep");
+
+    printf("\n%8s %8s %10s %14s %10s %10s %10s %10s\n", "tscore", "tiou", "mAP@0.5", "mAP@0.5:0.95", "post p50", "post p99", "infer p50", "dets/img");
+
+    for (float tiou : tious) {
+        for (float tscore : tscores) {
+            model->setConfig(MA_MODEL_CFG_OPT_THRESHOLD, tscore);
+            model->setConfig(MA_MODEL_CFG_OPT_NMS, tiou);
+
+            LatencyStats postprocess;
+            LatencyStats inference;
+            size_t detections = 0;
+            Results results;
+
+            for (auto& sample : samples) {
+                sample.detections.clear();
+
+                cv::Mat image = cv::imread(images + "/" + sample.file);
+                if (image.empty()) {
+                    MA_LOGW(TAG, "read failed: %s", sample.file.c_str());
+                    continue;
+                }
+                const int iw  = image.cols;
+                const int ih  = image.rows;
+                cv::Mat input = preprocessImage(image, model);
+                ma_img_t img  = toImage(input);
+                if (runModel(model, &img) != MA_OK) {
+                    continue;
+                }
+                auto perf = model->getPerf();
+                postprocess.add(perf.postprocess);
+                inference.add(perf.inference);
+
+                collectResults(model, results);
+                for (auto& box : results.boxes) {
+                    sample.detections.push_back(toSource(box, iw, ih, ow, oh, categories));
+                }
+                for (auto& keypoint : results.keypoints) {
+                    sample.detections.push_back(toSource(keypoint.box, iw, ih, ow, oh, categories));
+                }
+                for (auto& segment : results.segments) {
+                    sample.detections.push_back(toSource(segment.box, iw, ih, ow, oh, categories));
+                }
+                detections += sample.detections.size();
+            }
+
+            double map50   = 0.0;
+            double map5095 = 0.0;
+            evaluate(samples, threads, map50, map5095);
+
+            double per_image = samples.empty() ? 0.0 : static_cast<double>(detections) / samples.size();
+            printf("%8.3f %8.3f %10.4f %14.4f %10.2f %10.2f %10.2f %10.1f\n",
+                   tscore,
+                   tiou,
+                   map50,
+                   map5095,
+                   postprocess.percentile(50),
+                   postprocess.percentile(99),
+                   inference.percentile(50),
+                   per_image);
+
+            cJSON* point = cJSON_CreateObject();
+            cJSON_AddNumberToObject(point, "tscore", tscore);
+            cJSON_AddNumberToObject(point, "tiou", tiou);
+            cJSON_AddNumberToObject(point, "map50", map50);
+            cJSON_AddNumberToObject(point, "map50_95", map5095);
+            cJSON_AddNumberToObject(point, "postprocess_p50_ms", postprocess.percentile(50));
+            cJSON_AddNumberToObject(point, "postprocess_p99_ms", postprocess.percentile(99));
+            cJSON_AddNumberToObject(point, "inference_p50_ms", inference.percentile(50));
+            cJSON_AddNumberToObject(point, "detections_per_image", per_image);
+            cJSON_AddItemToArray(points, point);
+        }
+    }
+
+    if (!report.empty()) {
+        char* text = cJSON_Print(root);
+        FILE* file = fopen(report.c_str(), "w");
+        if (file != nullptr) {
+            fputs(text, file);
+            fclose(file);
+            MA_LOGI(TAG, "report: %s", report.c_str());
+        } else {
+            MA_LOGE(TAG, "write failed: %s", report.c_str());
+        }
+        cJSON_free(text);
+    }
+    cJSON_Delete(root);
+
+    return 0;
+}
@@ -2,6 +2,7 @@
 #include <fstream>
 #include <iostream>
 #include <numeric>
+#include <sstream>
 #include <stdio.h>
 #include <string>
 
@@ -9,21 +10,11 @@
 
 #include <sscma.h>
 
-#define TAG "main"
-
-class ColorPalette {
-public:
-    static std::vector<cv::Scalar> getPalette() {
-        return palette;
-    }
+#include "ma_engine_factory.h"
 
-    static cv::Scalar getColor(int index) {
-        return palette[index % palette.size()];
-    }
+#include "common.h"
 
-private:
-    static const std::vector<cv::Scalar> palette;
-};
+#define TAG "main"
 
 const std::vector<cv::Scalar> ColorPalette::palette = {
     cv::Scalar(0, 255, 0),     cv::Scalar(0, 170, 255), cv::Scalar(0, 128, 255), cv::Scalar(0, 64, 255),  cv::Scalar(0, 0, 255),     cv::Scalar(170, 0, 255),   cv::Scalar(128, 0, 255),
@@ -61,31 +52,85 @@ cv::Mat preprocessImage(cv::Mat& image, ma::Model* model) {
 }
 
 
-void drawMaskOnImage(int cls, cv::Mat& targetImage, const std::vector<uint8_t>& maskData, int maskWidth, int maskHeight, double alpha = 0.5) {
-    if (maskData.size() != (maskWidth * maskHeight) / 8) {
-        throw std::runtime_error("Mask data size is incorrect.");
+static std::vector<float> parseList(const char* text) {
+    std::vector<float> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        if (!item.empty()) {
+            values.push_back(std::stof(item));
+        }
     }
+    return values;
+}
+
+void drawResults(cv::Mat& image, const Results& results, bool verbose) {
+    if (results.type == MA_OUTPUT_TYPE_CLASS) {
+        for (auto& result : results.classes) {
+            char content[100];
+            sprintf(content, "%d(%.3f)", result.target, result.score);
+            cv::putText(image, content, cv::Point(20, 20), cv::FONT_HERSHEY_SIMPLEX, 0.8, ColorPalette::getColor(result.target), 2, cv::LINE_AA);
+            if (verbose) {
+                printf("score: %f target: %d\n", result.score, result.target);
+            }
+        }
+    } else if (results.type == MA_OUTPUT_TYPE_KEYPOINT) {
+        for (auto& result : results.keypoints) {
+            if (verbose) {
+                printf("x: %f, y: %f, w: %f, h: %f, score: %f target: %d\n", result.box.x, result.box.y, result.box.w, result.box.h, result.box.score, result.box.target);
+            }
+            for (auto& pt : result.pts) {
+                if (verbose) {
+                    printf("x: %f, y: %f\n", pt.x, pt.y);
+                }
+                cv::circle(image, cv::Point(pt.x * image.cols, pt.y * image.rows), 4, ColorPalette::getColor(result.box.target), -1);
+            }
+
+            float x1 = (result.box.x - result.box.w / 2.0) * image.cols;
+            float y1 = (result.box.y - result.box.h / 2.0) * image.rows;
+            float x2 = (result.box.x + result.box.w / 2.0) * image.cols;
+            float y2 = (result.box.y + result.box.h / 2.0) * image.rows;
 
-    cv::Mat maskImage(maskHeight, maskWidth, CV_8UC1, cv::Scalar(0));
+            char content[100];
+            sprintf(content, "%d(%.3f)", result.box.target, result.box.score);
 
-    for (int i = 0; i < maskHeight; ++i) {
-        for (int j = 0; j < maskWidth; ++j) {
-            if (maskData[i * maskWidth / 8 + j / 8] & (1 << (j % 8))) {
-                maskImage.at<uchar>(i, j) = 255;
+            cv::rectangle(image, cv::Point(x1, y1), cv::Point(x2, y2), ColorPalette::getColor(result.box.target), 2, 8, 0);
+            cv::putText(image, content, cv::Point(x1, y1 - 10), cv::FONT_HERSHEY_SIMPLEX, 0.6, ColorPalette::getColor(result.box.target), 2, cv::LINE_AA);
+        }
+    } else if (results.type == MA_OUTPUT_TYPE_SEGMENT) {
+        for (auto& result : results.segments) {
+            if (verbose) {
+                printf("x: %f, y: %f, w: %f, h: %f, score: %f target: %d\n", result.box.x, result.box.y, result.box.w, result.box.h, result.box.score, result.box.target);
             }
+            float x1 = (result.box.x - result.box.w / 2.0) * image.cols;
+            float y1 = (result.box.y - result.box.h / 2.0) * image.rows;
+            float x2 = (result.box.x + result.box.w / 2.0) * image.cols;
+            float y2 = (result.box.y + result.box.h / 2.0) * image.rows;
+
+            char content[100];
+            sprintf(content, "%d(%.3f)", result.box.target, result.box.score);
+
+            cv::rectangle(image, cv::Point(x1, y1), cv::Point(x2, y2), ColorPalette::getColor(result.box.target), 3, 8, 0);
+            cv::putText(image, content, cv::Point(x1, y1 - 10), cv::FONT_HERSHEY_SIMPLEX, 0.6, ColorPalette::getColor(result.box.target), 2, cv::LINE_AA);
+
+            drawMaskOnImage(result.box.target, image, result.mask.data, result.mask.width, result.mask.height, result.box);
         }
-    }
+    } else if (results.type == MA_OUTPUT_TYPE_BBOX) {
+        for (auto& result : results.boxes) {
+            // cx, cy, w, h
+            float x1 = (result.x - result.w / 2.0) * image.cols;
+            float y1 = (result.y - result.h / 2.0) * image.rows;
+            float x2 = (result.x + result.w / 2.0) * image.cols;
+            float y2 = (result.y + result.h / 2.0) * image.rows;
 
-    cv::Mat scaledMaskImage;
-    cv::resize(maskImage, scaledMaskImage, cv::Size(targetImage.cols, targetImage.rows), 0, 0, cv::INTER_LINEAR);
+            char content[100];
+            sprintf(content, "%d(%.3f)", result.target, result.score);
+
+            cv::rectangle(image, cv::Point(x1, y1), cv::Point(x2, y2), ColorPalette::getColor(result.target), 3, 8, 0);
+            cv::putText(image, content, cv::Point(x1, y1 - 10), cv::FONT_HERSHEY_SIMPLEX, 0.6, ColorPalette::getColor(result.target), 2, cv::LINE_AA);
 
-    for (int i = 0; i < scaledMaskImage.rows; ++i) {
-        for (int j = 0; j < scaledMaskImage.cols; ++j) {
-            cv::Vec3b& targetPixel = targetImage.at<cv::Vec3b>(i, j);
-            uchar maskPixel        = scaledMaskImage.at<uchar>(i, j);
-            if (maskPixel > 0) {
-                cv::Vec3b maskColor(ColorPalette::getColor(cls)[0], ColorPalette::getColor(cls)[1], ColorPalette::getColor(cls)[2]);
-                targetPixel = (1.0 - alpha) * targetPixel + alpha * maskColor;
+            if (verbose) {
+                printf("x: %f, y: %f, w: %f, h: %f, score: %f target: %d\n", result.x, result.y, result.w, result.h, result.score, result.target);
             }
         }
     }
@@ -93,23 +138,131 @@ void drawMaskOnImage(int cls, cv::Mat& targetImage, const std::vector<uint8_t>&
 
 int main(int argc, char** argv) {
 
-    if (argc < 3) {
+    // options first, the rest stays positional
+    std::vector<char*> args;
+    std::string engine_type;
+    int32_t input_width  = 0;
+    int32_t input_height = 0;
+    int32_t latency      = -1;
+    std::string benchmark;
+    std::string report;
+    int warmup         = 5;
+    int repeat         = 1;
+    std::string pipeline;
+    std::string output;
+    int workers = 3;
+    int writers = 2;
+    int depth   = 8;
+    std::string annotations;
+    std::string images;
+    std::vector<float> tscores = {0.25f};
+    std::vector<float> tious   = {0.45f};
+    int mask_bench             = 0;
+    int mask_instances         = 8;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--engine" && i + 1 < argc) {
+            engine_type = argv[++i];
+        } else if (arg == "--input" && i + 1 < argc) {
+            sscanf(argv[++i], "%dx%d", &input_width, &input_height);
+        } else if (arg == "--latency" && i + 1 < argc) {
+            latency = atoi(argv[++i]);
+        } else if (arg == "--benchmark" && i + 1 < argc) {
+            benchmark = argv[++i];
+        } else if (arg == "--warmup" && i + 1 < argc) {
+            warmup = atoi(argv[++i]);
+        } else if (arg == "--repeat" && i + 1 < argc) {
+            repeat = atoi(argv[++i]);
+        } else if (arg == "--report" && i + 1 < argc) {
+            report = argv[++i];
+        } else if (arg == "--pipeline" && i + 1 < argc) {
+            pipeline = argv[++i];
+        } else if (arg == "--output" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg == "--workers" && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        } else if (arg == "--writers" && i + 1 < argc) {
+            writers = atoi(argv[++i]);
+        } else if (arg == "--queue" && i + 1 < argc) {
+            depth = atoi(argv[++i]);
+        } else if (arg == "--eval" && i + 1 < argc) {
+            annotations = argv[++i];
+        } else if (arg == "--images" && i + 1 < argc) {
+            images = argv[++i];
+        } else if (arg == "--tscore" && i + 1 < argc) {
+            tscores = parseList(argv[++i]);
+        } else if (arg == "--tiou" && i + 1 < argc) {
+            tious = parseList(argv[++i]);
+        } else if (arg == "--mask-bench" && i + 1 < argc) {
+            mask_bench = atoi(argv[++i]);
+        } else if (arg == "--instances" && i + 1 < argc) {
+            mask_instances = atoi(argv[++i]);
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+
+    if (mask_bench > 0) {
+        return runMaskBenchmark(mask_bench, mask_instances);
+    }
+
+    if (args.size() < (benchmark.empty() && pipeline.empty() && annotations.empty() ? 2 : 1)) {
         printf("Usage:\n");
-        printf("   %s cvimodel image.jpg image_detected.jpg\n", argv[0]);
+        printf("   %s [options] model image.jpg image_detected.jpg\n", argv[0]);
+        printf("   %s [options] --benchmark <dir|glob|video> model\n", argv[0]);
+        printf("   %s [options] --pipeline <dir|glob|video> model\n", argv[0]);
+        printf("   %s [options] --eval instances.json --images dir model\n", argv[0]);
         printf("ex: %s yolo11.hf cat.jpg out.jpg \n", argv[0]);
+        printf("options:\n");
+        printf("   --engine <type>  one of:");
+        for (auto& type : ma::engine::EngineFactory::available()) {
+            printf(" %s", type.c_str());
+        }
+        printf(" (default: first one)\n");
+        printf("   --input WxH      input size of the cpu engine (default: 640x640)\n");
+        printf("   --latency ms     fixed latency of the mock engine\n");
+        printf("   --benchmark in   run every image of in with the model kept loaded, report latency percentiles\n");
+        printf("   --warmup N       untimed runs on the first input before measuring (default: 5)\n");
+        printf("   --repeat N       passes over the input (default: 1)\n");
+        printf("   --report file    machine readable result (default: benchmark.json / eval.json)\n");
+        printf("   --pipeline in    decode/letterbox, inference and annotation on separate threads, reports throughput\n");
+        printf("   --output dir     annotated images of the pipeline, nothing is written when omitted\n");
+        printf("   --workers N      decode/letterbox threads (default: 3)\n");
+        printf("   --writers N      annotation/write threads (default: 2)\n");
+        printf("   --queue N        ready and done queue depth (default: 8)\n");
+        printf("   --eval file      COCO annotations, reports box mAP@0.5 and mAP@0.5:0.95 per threshold\n");
+        printf("   --images dir     images referenced by the annotations (default: next to the annotations)\n");
+        printf("   --tscore a,b,..  score thresholds to sweep (default: 0.25)\n");
+        printf("   --tiou a,b,..    NMS IoU thresholds to sweep (default: 0.45)\n");
+        printf("   --workers N      also the matching threads of --eval\n");
+        printf("   --mask-bench N   time mask rendering against the per-pixel reference over N runs, no model needed\n");
+        printf("   --instances N    masks per frame of --mask-bench (default: 8)\n");
         exit(-1);
     }
 
     ma_err_t ret = MA_OK;
-    auto* engine = new EngineDefault;
-    ret          = engine->init();
+    // resolve the default here, engine specific options like --latency test the name
+    if (engine_type.empty() && !ma::engine::EngineFactory::available().empty()) {
+        engine_type = ma::engine::EngineFactory::available().front();
+    }
+    auto* engine = ma::engine::EngineFactory::create(engine_type, input_width, input_height);
+    if (engine == nullptr) {
+        MA_LOGE(TAG, "engine not available: %s", engine_type.c_str());
+        return 1;
+    }
+#if CONFIG_MA_ENGINE_MOCK
+    if (engine_type == "mock" && latency >= 0) {
+        static_cast<ma::engine::EngineMock*>(engine)->setLatency(latency);
+    }
+#endif
+    ret = engine->init();
     if (ret != MA_OK) {
         MA_LOGE(TAG, "engine init failed");
         return 1;
     }
-    ret = engine->load(argv[1]);
+    ret = engine->load(args[0]);
 
-    MA_LOGI(TAG, "engine load model %s", argv[1]);
+    MA_LOGI(TAG, "engine load model %s", args[0]);
     if (ret != MA_OK) {
         MA_LOGE(TAG, "engine load model failed");
         return 1;
@@ -129,9 +282,31 @@ int main(int argc, char** argv) {
         return 1;
     }
 
+    if (!benchmark.empty()) {
+        int code = runBenchmark(model, benchmark, warmup, repeat, report.empty() ? "benchmark.json" : report);
+        ma::ModelFactory::remove(model);
+        return code;
+    }
+
+    if (!annotations.empty()) {
+        if (images.empty()) {
+            size_t pos = annotations.find_last_of('/');
+            images     = pos == std::string::npos ? "." : annotations.substr(0, pos);
+        }
+        int code = runEval(model, annotations, images, tscores, tious, workers, report.empty() ? "eval.json" : report);
+        ma::ModelFactory::remove(model);
+        return code;
+    }
+
+    if (!pipeline.empty()) {
+        int code = runPipeline(model, pipeline, output, workers, writers, depth);
+        ma::ModelFactory::remove(model);
+        return code;
+    }
+
     // imread
     cv::Mat image;
-    image = cv::imread(argv[2]);
+    image = cv::imread(args[1]);
 
     if (!image.data) {
         MA_LOGE(TAG, "read image failed");
@@ -140,94 +315,24 @@ int main(int argc, char** argv) {
 
     image = preprocessImage(image, model);
 
-    ma_img_t img;
-    img.data   = (uint8_t*)image.data;
-    img.size   = image.rows * image.cols * image.channels();
-    img.width  = image.cols;
-    img.height = image.rows;
-    img.format = MA_PIXEL_FORMAT_RGB888;
-    img.rotate = MA_PIXEL_ROTATE_0;
+    ma_img_t img = toImage(image);
 
     if (model->getOutputType() == MA_OUTPUT_TYPE_CLASS) {
-        ma::model::Classifier* classifier = static_cast<ma::model::Classifier*>(model);
-        classifier->setConfig(MA_MODEL_CFG_OPT_THRESHOLD, 0.1f);
-        classifier->run(&img);
-        auto _results = classifier->getResults();
-        for (auto result : _results) {
-            char content[100];
-            sprintf(content, "%d(%.3f)", result.target, result.score);
-            cv::putText(image, content, cv::Point(20, 20), cv::FONT_HERSHEY_SIMPLEX, 0.8, ColorPalette::getColor(result.target), 2, cv::LINE_AA);
-            printf("score: %f target: %d\n", result.score, result.target);
-        }
-    } else if (model->getOutputType() == MA_OUTPUT_TYPE_KEYPOINT) {
-        ma::model::PoseDetector* detector = static_cast<ma::model::PoseDetector*>(model);
-        detector->run(&img);
-        auto _results = detector->getResults();
-        for (auto result : _results) {
-            printf("x: %f, y: %f, w: %f, h: %f, score: %f target: %d\n", result.box.x, result.box.y, result.box.w, result.box.h, result.box.score, result.box.target);
-            for (auto pt : result.pts) {
-                printf("x: %f, y: %f\n", pt.x, pt.y);
-                cv::circle(image, cv::Point(pt.x * image.cols, pt.y * image.rows), 4, ColorPalette::getColor(result.box.target), -1);
-            }
-
-            float x1 = (result.box.x - result.box.w / 2.0) * image.cols;
-            float y1 = (result.box.y - result.box.h / 2.0) * image.rows;
-            float x2 = (result.box.x + result.box.w / 2.0) * image.cols;
-            float y2 = (result.box.y + result.box.h / 2.0) * image.rows;
-
-            char content[100];
-            sprintf(content, "%d(%.3f)", result.box.target, result.box.score);
-
-            cv::rectangle(image, cv::Point(x1, y1), cv::Point(x2, y2), ColorPalette::getColor(result.box.target), 2, 8, 0);
-            cv::putText(image, content, cv::Point(x1, y1 - 10), cv::FONT_HERSHEY_SIMPLEX, 0.6, ColorPalette::getColor(result.box.target), 2, cv::LINE_AA);
-        }
-    } else if (model->getOutputType() == MA_OUTPUT_TYPE_SEGMENT) {
-        ma::model::Segmentor* segmenter = static_cast<ma::model::Segmentor*>(model);
-        segmenter->run(&img);
-        auto _results = segmenter->getResults();
-        for (auto result : _results) {
-            printf("x: %f, y: %f, w: %f, h: %f, score: %f target: %d\n", result.box.x, result.box.y, result.box.w, result.box.h, result.box.score, result.box.target);
-            float x1 = (result.box.x - result.box.w / 2.0) * image.cols;
-            float y1 = (result.box.y - result.box.h / 2.0) * image.rows;
-            float x2 = (result.box.x + result.box.w / 2.0) * image.cols;
-            float y2 = (result.box.y + result.box.h / 2.0) * image.rows;
-
-            char content[100];
-            sprintf(content, "%d(%.3f)", result.box.target, result.box.score);
-
-            cv::rectangle(image, cv::Point(x1, y1), cv::Point(x2, y2), ColorPalette::getColor(result.box.target), 3, 8, 0);
-            cv::putText(image, content, cv::Point(x1, y1 - 10), cv::FONT_HERSHEY_SIMPLEX, 0.6, ColorPalette::getColor(result.box.target), 2, cv::LINE_AA);
-
-            drawMaskOnImage(result.box.target, image, result.mask.data, result.mask.width, result.mask.height);
-        }
-    } else if (model->getOutputType() == MA_OUTPUT_TYPE_BBOX) {
-        ma::model::Detector* detector = static_cast<ma::model::Detector*>(model);
-        detector->run(&img);
-        auto _results = detector->getResults();
-        for (auto result : _results) {
-            // cx, cy, w, h
-            float x1 = (result.x - result.w / 2.0) * image.cols;
-            float y1 = (result.y - result.h / 2.0) * image.rows;
-            float x2 = (result.x + result.w / 2.0) * image.cols;
-            float y2 = (result.y + result.h / 2.0) * image.rows;
-
-            char content[100];
-            sprintf(content, "%d(%.3f)", result.target, result.score);
-
-            cv::rectangle(image, cv::Point(x1, y1), cv::Point(x2, y2), ColorPalette::getColor(result.target), 3, 8, 0);
-            cv::putText(image, content, cv::Point(x1, y1 - 10), cv::FONT_HERSHEY_SIMPLEX, 0.6, ColorPalette::getColor(result.target), 2, cv::LINE_AA);
-
-            printf("x: %f, y: %f, w: %f, h: %f, score: %f target: %d\n", result.x, result.y, result.w, result.h, result.score, result.target);
-        }
+        model->setConfig(MA_MODEL_CFG_OPT_THRESHOLD, 0.1f);
     }
+    runModel(model, &img);
+
+    Results results;
+    collectResults(model, results);
+    drawResults(image, results, true);
 
     auto perf = model->getPerf();
     MA_LOGI(TAG, "pre: %ldms, infer: %ldms, post: %ldms", perf.preprocess, perf.inference, perf.postprocess);
 
     cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
 
-    if (argc >= 4) {
-        cv::imwrite(argv[3], image);
+    if (args.size() >= 3) {
+        cv::imwrite(args[2], image);
     } else {
         cv::imwrite("result.jpg", image);
     }
@@ -0,0 +1,200 @@
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdio.h>
+
+#include "common.h"
+
+#define TAG "mask"
+
+namespace {
+
+// byte -> 8 pixels, bit j is pixel j (lsb first), set bits become 255
+struct UnpackTable {
+    uint8_t pixels[256][8];
+
+    UnpackTable() {
+        for (int byte = 0; byte < 256; byte++) {
+            for (int bit = 0; bit < 8; bit++) {
+                pixels[byte][bit] = (byte >> bit) & 1 ? 255 : 0;
+            }
+        }
+    }
+};
+
+const UnpackTable& unpackTable() {
+    static const UnpackTable table;
+    return table;
+}
+
+// per-pixel reference, kept for --mask-bench
+void drawMaskOnImageReference(int cls, cv::Mat& targetImage, const std::vector<uint8_t>& maskData, int maskWidth, int maskHeight, double alpha) {
+    cv::Mat maskImage(maskHeight, maskWidth, CV_8UC1, cv::Scalar(0));
+
+    for (int i = 0; i < maskHeight; ++i) {
+        for (int j = 0; j < maskWidth; ++j) {
+            if (maskData[i * maskWidth / 8 + j / 8] & (1 << (j % 8))) {
+                maskImage.at<uchar>(i, j) = 255;
+            }
+        }
+    }
+
+    cv::Mat scaledMaskImage;
+    cv::resize(maskImage, scaledMaskImage, cv::Size(targetImage.cols, targetImage.rows), 0, 0, cv::INTER_LINEAR);
+
+    for (int i = 0; i < scaledMaskImage.rows; ++i) {
+        for (int j = 0; j < scaledMaskImage.cols; ++j) {
+            cv::Vec3b& targetPixel = targetImage.at<cv::Vec3b>(i, j);
+            uchar maskPixel        = scaledMaskImage.at<uchar>(i, j);
+            if (maskPixel > 0) {
+                cv::Vec3b maskColor(ColorPalette::getColor(cls)[0], ColorPalette::getColor(cls)[1], ColorPalette::getColor(cls)[2]);
+                targetPixel = (1.0 - alpha) * targetPixel + alpha * maskColor;
+            }
+        }
+    }
+}
+
+double elapsed(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+// Only the mask cells under the box are unpacked (a byte per lookup) and scaled, the blend runs on the
+// box with OpenCV's vectorized addWeighted/copyTo. Matches the reference inside the box up to the odd
+// edge pixel of the bilinear scale, nothing outside the box is touched.
+void drawMaskOnImage(int cls, cv::Mat& targetImage, const std::vector<uint8_t>& maskData, int maskWidth, int maskHeight, const ma_bbox_t& box, double alpha) {
+    if (maskData.size() != (maskWidth * maskHeight) / 8) {
+        throw std::runtime_error("Mask data size is incorrect.");
+    }
+    if (maskWidth % 8 != 0 || targetImage.type() != CV_8UC3) {
+        drawMaskOnImageReference(cls, targetImage, maskData, maskWidth, maskHeight, alpha);
+        return;
+    }
+
+    const int width  = targetImage.cols;
+    const int height = targetImage.rows;
+
+    cv::Rect bounds(cv::Point(std::floor((box.x - box.w / 2.0) * width), std::floor((box.y - box.h / 2.0) * height)),
+                    cv::Point(std::ceil((box.x + box.w / 2.0) * width), std::ceil((box.y + box.h / 2.0) * height)));
+    bounds &= cv::Rect(0, 0, width, height);
+    if (bounds.empty()) {
+        return;
+    }
+
+    // mask cells covering the box, one extra cell around for the bilinear taps
+    const double sx = (double)maskWidth / width;
+    const double sy = (double)maskHeight / height;
+    cv::Rect cells(cv::Point(std::floor(bounds.x * sx) - 1, std::floor(bounds.y * sy) - 1), cv::Point(std::ceil(bounds.br().x * sx) + 1, std::ceil(bounds.br().y * sy) + 1));
+    cells &= cv::Rect(0, 0, maskWidth, maskHeight);
+    if (cells.empty()) {
+        return;
+    }
+
+    // whole bytes, 8 pixels per lookup
+    const auto& table = unpackTable();
+    const int stride  = maskWidth / 8;
+    const int first   = cells.x / 8;
+    const int last    = (cells.br().x + 7) / 8;
+    cv::Mat unpacked(cells.height, (last - first) * 8, CV_8UC1);
+    for (int y = 0; y < cells.height; y++) {
+        const uint8_t* src = maskData.data() + (cells.y + y) * stride + first;
+        uint8_t* dst       = unpacked.ptr<uint8_t>(y);
+        for (int x = 0; x < last - first; x++) {
+            std::memcpy(dst + x * 8, table.pixels[src[x]], 8);
+        }
+    }
+
+    // the pixels those cells cover, clipped to the box
+    cv::Rect covered(cv::Point(std::lround(cells.x / sx), std::lround(cells.y / sy)), cv::Point(std::lround(cells.br().x / sx), std::lround(cells.br().y / sy)));
+    cv::Rect region = bounds & covered;
+    if (region.empty()) {
+        return;
+    }
+    cv::Mat scaled;
+    cv::resize(unpacked(cv::Rect(cells.x - first * 8, 0, cells.width, cells.height)), scaled, covered.size(), 0, 0, cv::INTER_LINEAR);
+
+    // colour once, blend the whole box, keep it where the mask is set
+    cv::Mat roi      = targetImage(region);
+    cv::Scalar color = ColorPalette::getColor(cls);
+    cv::Mat blended;
+    cv::addWeighted(roi, 1.0 - alpha, cv::Mat(roi.size(), roi.type(), color), alpha, 0.0, blended);
+    blended.copyTo(roi, scaled(region - covered.tl()));
+}
+
+// Synthetic 640x640 frame with `instances` elliptic 160x160 masks, both implementations on the same input.
+int runMaskBenchmark(int iterations, int instances) {
+    const int width  = 640;
+    const int height = 640;
+    const int mw     = 160;
+    const int mh     = 160;
+
+    cv::RNG rng(0x55aa);
+    cv::Mat frame(height, width, CV_8UC3);
+    rng.fill(frame, cv::RNG::UNIFORM, 0, 255);
+
+    struct Instance {
+        ma_bbox_t box;
+        std::vector<uint8_t> bits;
+    };
+    std::vector<Instance> masks(std::max(instances, 1));
+    for (size_t i = 0; i < masks.size(); i++) {
+        auto& instance = masks[i];
+        float w        = rng.uniform(0.1f, 0.4f);
+        float h        = rng.uniform(0.1f, 0.4f);
+        instance.box.x = rng.uniform(w / 2, 1.0f - w / 2);
+        instance.box.y = rng.uniform(h / 2, 1.0f - h / 2);
+        instance.box.w = w;
+        instance.box.h = h;
+
+        cv::Mat shape(mh, mw, CV_8UC1, cv::Scalar(0));
+        cv::ellipse(shape, cv::Point(instance.box.x * mw, instance.box.y * mh), cv::Size(w * mw / 2 - 1, h * mh / 2 - 1), 0, 0, 360, cv::Scalar(255), cv::FILLED);
+        instance.bits.assign(mw * mh / 8, 0);
+        for (int y = 0; y < mh; y++) {
+            for (int x = 0; x < mw; x++) {
+                if (shape.at<uchar>(y, x)) {
+                    instance.bits[y * mw / 8 + x / 8] |= 1 << (x % 8);
+                }
+            }
+        }
+    }
+
+    LatencyStats reference;
+    LatencyStats vectorized;
+    cv::Mat expected;
+    cv::Mat actual;
+    for (int n = 0; n < std::max(iterations, 1); n++) {
+        expected   = frame.clone();
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < masks.size(); i++) {
+            drawMaskOnImageReference(i, expected, masks[i].bits, mw, mh, 0.5);
+        }
+        reference.add(elapsed(start));
+
+        actual = frame.clone();
+        start  = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < masks.size(); i++) {
+            drawMaskOnImage(i, actual, masks[i].bits, mw, mh, masks[i].box, 0.5);
+        }
+        vectorized.add(elapsed(start));
+    }
+
+    // pixels off by more than the blend rounding
+    cv::Mat diff;
+    cv::Mat close;
+    cv::absdiff(expected, actual, diff);
+    cv::inRange(diff, cv::Scalar::all(0), cv::Scalar::all(1), close);
+    int mismatched = width * height - cv::countNonZero(close);
+
+    printf("\n%-12s %10s %10s %10s\n", "mask(ms)", "mean", "p50", "p99");
+    printf("%-12s %10.3f %10.3f %10.3f\n", "reference", reference.mean(), reference.percentile(50), reference.percentile(99));
+    printf("%-12s %10.3f %10.3f %10.3f\n", "vectorized", vectorized.mean(), vectorized.percentile(50), vectorized.percentile(99));
+    printf("\ninstances: %zu, iterations: %d, speedup: %.1fx, mismatched pixels: %d (%.3f%%)\n",
+           masks.size(),
+           std::max(iterations, 1),
+           vectorized.mean() > 0 ? reference.mean() / vectorized.mean() : 0.0,
+           mismatched,
+           mismatched * 100.0 / (width * height));
+
+    return 0;
+}
@@ -0,0 +1,219 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+
+#include "common.h"
+
+#define TAG "pipeline"
+
+namespace {
+
+// blocking bounded FIFO, close() wakes everybody and lets consumers drain what is left
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : capacity_(std::max<size_t>(capacity, 1)), closed_(false), peak_(0) {}
+
+    bool push(T&& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_full_.wait(lock, [this] { return closed_ || queue_.size() < capacity_; });
+        if (closed_) {
+            return false;
+        }
+        queue_.push_back(std::move(item));
+        peak_ = std::max(peak_, queue_.size());
+        not_empty_.notify_one();
+        return true;
+    }
+
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        not_empty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+        if (queue_.empty()) {
+            return false;
+        }
+        item = std::move(queue_.front());
+        queue_.pop_front();
+        not_full_.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        closed_ = true;
+        not_empty_.notify_all();
+        not_full_.notify_all();
+    }
+
+    size_t peak() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return peak_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<T> queue_;
+    size_t capacity_;
+    bool closed_;
+    size_t peak_;
+};
+
+struct Item {
+    size_t index;
+    std::string name;
+    cv::Mat input;  // letterboxed RGB
+    Results results;
+};
+
+double elapsed(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+// Decode + letterbox on a worker pool, inference on this thread, annotation + write on a writer pool.
+// The accelerator only waits when the ready queue runs dry, which the report shows as idle time.
+// Its busy time is the model's own inference figure, run+copy also holds the CPU pre/postprocess.
+int runPipeline(ma::Model* model, const std::string& input, const std::string& output, int workers, int writers, int depth) {
+    InputReader reader;
+    if (!reader.open(input)) {
+        return 1;
+    }
+    if (!output.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(output, ec);
+    }
+
+    workers = std::max(workers, 1);
+    writers = std::max(writers, 1);
+
+    BoundedQueue<Item> ready(depth);
+    BoundedQueue<Item> done(depth);
+
+    std::mutex reader_mutex;
+    std::atomic<size_t> next(0);
+    std::atomic<size_t> written(0);
+    std::atomic<size_t> failed(0);
+    std::atomic<int> producers(workers);
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < workers; i++) {
+        threads.emplace_back([&] {
+            while (true) {
+                Item item;
+                cv::Mat image;
+                if (reader.isVideo()) {
+                    // a video decodes in order, only the letterbox runs in parallel
+                    std::lock_guard<std::mutex> lock(reader_mutex);
+                    if (!reader.next(image, &item.name)) {
+                        break;
+                    }
+                    item.index = next++;
+                } else {
+                    item.index = next++;
+                    if (item.index >= reader.files().size()) {
+                        break;
+                    }
+                    item.name = reader.files()[item.index];
+                    image     = cv::imread(item.name);
+                    if (image.empty()) {
+                        MA_LOGW(TAG, "read failed: %s", item.name.c_str());
+                        failed++;
+                        continue;
+                    }
+                }
+                item.input = preprocessImage(image, model);
+                if (!ready.push(std::move(item))) {
+                    break;
+                }
+            }
+            if (--producers == 0) {
+                ready.close();
+            }
+        });
+    }
+
+    for (int i = 0; i < writers; i++) {
+        threads.emplace_back([&] {
+            Item item;
+            while (done.pop(item)) {
+                if (output.empty()) {
+                    written++;
+                    continue;
+                }
+                drawResults(item.input, item.results);
+                cv::cvtColor(item.input, item.input, cv::COLOR_RGB2BGR);
+
+                std::string name = std::filesystem::path(item.name).filename().string();
+                if (reader.isVideo()) {
+                    name = std::to_string(item.index) + ".jpg";
+                }
+                if (cv::imwrite(output + "/" + name, item.input)) {
+                    written++;
+                } else {
+                    failed++;
+                }
+            }
+        });
+    }
+
+    // inference stays on one thread, the model owns a single set of buffers
+    LatencyStats inference;
+    LatencyStats accelerator;
+    LatencyStats wait;
+    Item item;
+    while (true) {
+        auto wait_start = std::chrono::steady_clock::now();
+        if (!ready.pop(item)) {
+            break;
+        }
+        wait.add(elapsed(wait_start));
+
+        auto infer_start = std::chrono::steady_clock::now();
+        ma_img_t img     = toImage(item.input);
+        if (runModel(model, &img) != MA_OK) {
+            failed++;
+            continue;
+        }
+        collectResults(model, item.results);
+        inference.add(elapsed(infer_start));
+        accelerator.add(model->getPerf().inference);
+
+        done.push(std::move(item));
+    }
+    done.close();
+
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    double wall   = elapsed(start);
+    double busy   = accelerator.mean() * accelerator.samples.size();
+    size_t images = inference.samples.size();
+
+    printf("\nimages: %zu, written: %zu, failed: %zu, workers: %d, writers: %d, queue: %d\n", images, written.load(), failed.load(), workers, writers, depth);
+    printf("wall: %.1fms, throughput: %.2f img/s\n", wall, wall > 0 ? images * 1000.0 / wall : 0.0);
+    printf("run+copy: mean %.2fms p50 %.2fms p99 %.2fms\n", inference.mean(), inference.percentile(50), inference.percentile(99));
+    printf("inference: mean %.2fms p50 %.2fms p99 %.2fms, bound: %.2f img/s\n",
+           accelerator.mean(),
+           accelerator.percentile(50),
+           accelerator.percentile(99),
+           accelerator.mean() > 0 ? 1000.0 / accelerator.mean() : 0.0);
+    printf("accelerator busy: %.1f%%, run+copy busy: %.1f%%, waited on input: %.1fms total, queue peak: %zu/%zu\n",
+           wall > 0 ? busy * 100.0 / wall : 0.0,
+           wall > 0 ? inference.mean() * inference.samples.size() * 100.0 / wall : 0.0,
+           wait.mean() * wait.samples.size(),
+           ready.peak(),
+           done.peak());
+
+    return failed.load() == 0 ? 0 : 1;
+}
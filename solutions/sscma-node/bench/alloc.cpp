@@ -0,0 +1,213 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "model.h"
+
+// Allocation check of the model node publish stage, a binary of its own: it replaces the global operator new,
+// which sscma-node itself must not carry.
+//
+//   sscma-node-alloc [N]   N steady frames per scene after the warm up (default 1000)
+
+namespace ma::node {
+
+// constant initialized, so touching them never allocates thread local storage on its own
+static thread_local bool counting      = false;
+static thread_local uint64_t allocated = 0;
+
+static void countAllocations(bool enable) {
+    counting = enable;
+    if (enable) {
+        allocated = 0;
+    }
+}
+
+static uint64_t allocations() {
+    return allocated;
+}
+
+}  // namespace ma::node
+
+void* operator new(std::size_t size) {
+    if (ma::node::counting) {
+        ma::node::allocated++;
+    }
+    void* ptr = malloc(size > 0 ? size : 1);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    free(ptr);
+}
+
+namespace ma::node {
+
+// a scene repeats itself every ALLOC_PERIOD frames, so the warm up sees every state once
+#define ALLOC_PERIOD 60
+#define ALLOC_WARMUP (ALLOC_PERIOD * 2)
+
+// ModelNode::build() on synthetic jobs, the way publishEntry() drives it: tracker, publish-on-change, zones,
+// the splitter counter when counting and the writer in every format, one frame after another into reused
+// buffers; fails when a frame after the warm up allocates, as counting does for now: Counter::get() of the
+// sscma-micro extension hands out a new vector every frame
+int benchmarkAllocations(int frames) {
+    struct Scene {
+        int objects;
+        bool counting;
+        NodeServer::Format format;
+    };
+    const Scene scenes[] = {{10, false, NodeServer::Format::JSON},
+                            {50, false, NodeServer::Format::JSON},
+                            {200, false, NodeServer::Format::JSON},
+                            {50, false, NodeServer::Format::CBOR},
+                            {50, false, NodeServer::Format::MSGPACK},
+                            {50, true, NodeServer::Format::JSON}};
+    const char* formats[] = {"json", "cbor", "msgpack"};
+
+    frames = std::max(frames, 1);
+
+    struct Object {
+        float x;
+        float y;
+        float ax;  // amplitude and phase of the motion, periodic
+        float ay;
+        float phase;
+        float w;
+        float h;
+        int32_t target;
+    };
+
+    int failed = 0;
+    printf("%8s %8s %8s %8s %10s %10s %10s %10s\n", "objects", "counting", "format", "frames", "warmup", "steady", "bytes", "us/frame");
+    for (const Scene& scene : scenes) {
+        const int n = scene.objects;
+
+        // walkers around fixed centres through a line and a polygon, tracks never get lost
+        std::vector<Object> objects(n);
+        for (int i = 0; i < n; i++) {
+            objects[i] = {0.1f + 0.8f * ((i * 37) % 100) / 100.0f,
+                          0.1f + 0.8f * ((i * 53) % 100) / 100.0f,
+                          0.02f + 0.03f * (i % 3),
+                          0.03f + 0.02f * (i % 4),
+                          i * 0.7f,
+                          0.02f + 0.01f * (i % 4),
+                          0.04f + 0.02f * (i % 3),
+                          i % 3};
+        }
+
+        // configured like onControl does it, never created or started: no model, no camera, no server
+        ModelNode node("alloc");
+        node.labels_           = {"person", "car", "bicycle"};
+        node.pending_.trace    = true;
+        node.pending_.counting = scene.counting;
+        node.pending_.format   = scene.format;
+        node.pending_.splitter = {0, 50, 100, 50};
+        node.pending_.splitter_epoch++;
+        // a keyframe every 30 frames, on the same frames of the scene every period
+        node.setEmit(json::parse(R"({"mode": "change", "tolerance": 0.01, "score": 10, "keyframe": 990})"));
+        node.setZones(json::parse(R"([{"name": "door", "line": [50, 0, 50, 100]}, {"name": "queue", "polygon": [20, 20, 45, 20, 45, 45, 20, 45]}])"));
+        node.commit();
+        const std::shared_ptr<const ModelNode::Options> options = node.options();
+
+        ModelNode::PublishState state{};
+        state.width    = 640;
+        state.height   = 640;
+        state.type     = MA_OUTPUT_TYPE_BBOX;
+        state.splitter = node.counter_.getSplitter();
+
+        ModelJob* job      = new ModelJob();
+        job->global        = true;
+        job->frame_width   = 1280;
+        job->frame_height  = 720;
+        job->scaled_width  = 640;
+        job->scaled_height = 360;
+        job->top           = 140;
+        std::string sent;  // stands in for the server, which swaps in a spare buffer
+
+        // captured in the past, the ages stay plausible
+        ma_tick_t origin = Tick::current() - Tick::fromMilliseconds((ALLOC_WARMUP + frames) * 33);
+        uint64_t warmup  = 0;
+        uint64_t steady  = 0;
+        size_t bytes     = 0;
+        double elapsed   = 0.0;
+        for (int f = 0; f < ALLOC_WARMUP + frames; f++) {
+            // what the pre-process and inference stages leave in the job
+            float t = 6.2831853f * (f % ALLOC_PERIOD) / ALLOC_PERIOD;
+            job->boxes.resize(n);
+            for (int i = 0; i < n; i++) {
+                const Object& object = objects[i];
+                job->boxes[i].x      = object.x + object.ax * std::sin(t + object.phase);
+                job->boxes[i].y      = object.y + object.ay * std::cos(t + object.phase);
+                job->boxes[i].w      = object.w;
+                job->boxes[i].h      = object.h;
+                job->boxes[i].score  = 0.8f + 0.1f * std::sin(t * 3 + i);
+                job->boxes[i].target = object.target;
+            }
+            job->count     = f;
+            job->sequence  = f;
+            job->timestamp = origin + Tick::fromMilliseconds(f * 33);
+            job->dequeued  = job->timestamp;
+            job->prepared  = job->timestamp;
+            job->started   = job->timestamp;
+            job->inferred  = job->timestamp;
+
+            if (f == 0) {
+                countAllocations(true);
+            } else if (f == ALLOC_WARMUP) {
+                warmup  = allocations();
+                elapsed = 0.0;
+                countAllocations(true);
+            }
+            auto start = std::chrono::steady_clock::now();
+            if (node.build(job, *options, state)) {
+                bytes = state.payload.size();
+                state.payload.swap(sent);
+            }
+            elapsed += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        }
+        steady = allocations();
+        countAllocations(false);
+        delete job;
+
+        printf("%8d %8s %8s %8d %10llu %10llu %10zu %10.2f\n",
+               n,
+               scene.counting ? "yes" : "no",
+               formats[static_cast<int>(scene.format)],
+               frames,
+               static_cast<unsigned long long>(warmup),
+               static_cast<unsigned long long>(steady),
+               bytes,
+               elapsed / frames);
+        if (steady > 0) {
+            failed++;
+        }
+    }
+
+    if (failed > 0) {
+        printf("FAILED: the steady state allocates\n");
+        return 1;
+    }
+    printf("OK: no allocation after the warm up\n");
+    return 0;
+}
+
+}  // namespace ma::node
+
+int main(int argc, char** argv) {
+    int frames = 1000;
+    if (argc > 1) {
+        frames = std::atoi(argv[1]);
+    }
+    return ma::node::benchmarkAllocations(frames);
+}
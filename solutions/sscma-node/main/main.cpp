@@ -8,6 +8,7 @@
 #include "signal.h"
 
 #include "node/server.h"
+#include "node/tracker.h"
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
@@ -29,6 +30,9 @@ void show_help() {
               << "  -h, --help           Show this help message\n"
               << "  --start              Start the service\n"
               << "  --deamon             Run in deamon mode\n"
+              << "  --bench-tracker [N]  Time the tracker on N synthetic frames (default 300)\n"
+              << "  --bench-executor [N] Time N create/config/destroy round trips through the server (default 1000)\n"
+              << "  --bench-format [N]   Write synthetic results N times as JSON, CBOR and MessagePack (default 1000)\n"
               << std::endl;
 }
 
@@ -67,6 +71,24 @@ int main(int argc, char** argv) {
             start_service = true;
         } else if (arg == "--deamon") {
             deamon = true;
+        } else if (arg == "--bench-tracker") {
+            int frames = 300;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                frames = std::atoi(argv[++i]);
+            }
+            return benchmarkTracker(frames);
+        } else if (arg == "--bench-executor") {
+            int requests = 1000;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                requests = std::atoi(argv[++i]);
+            }
+            return benchmarkExecutor(requests);
+        } else if (arg == "--bench-format") {
+            int iterations = 1000;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                iterations = std::atoi(argv[++i]);
+            }
+            return benchmarkFormat(iterations);
         } else {
             std::cerr << "Error: Unknown option " << arg << std::endl;
             return 1;
@@ -4,7 +4,54 @@ namespace ma::node {
 
 static constexpr char TAG[] = "ma::node::camera";
 
-CameraNode::CameraNode(std::string id) : Node("camera", std::move(id)), thread_(nullptr) {}
+// frames in flight between the capture loop and its consumers, each slot holds one full-size BGR image
+#define CAMERA_FRAME_POOL_SIZE 4
+
+FrameMailbox::FrameMailbox() : sem_(0), frame_(nullptr), gate_(nullptr), dropped_(0) {}
+
+FrameMailbox::~FrameMailbox() {
+    clear();
+}
+
+void FrameMailbox::post(videoFrame* frame) {
+    videoFrame* stale = nullptr;
+    {
+        Guard guard(mutex_);
+        stale  = frame_;
+        frame_ = frame;
+    }
+    if (stale != nullptr) {
+        // the consumer is behind, the signal of the stale frame now stands for this one
+        stale->release();
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        sem_.signal();
+    }
+}
+
+bool FrameMailbox::fetch(videoFrame** frame, ma_tick_t timeout) {
+    if (!sem_.wait(timeout)) {
+        return false;
+    }
+    Guard guard(mutex_);
+    *frame = frame_;
+    frame_ = nullptr;
+    return *frame != nullptr;  // cleared in the meantime
+}
+
+void FrameMailbox::clear() {
+    videoFrame* stale = nullptr;
+    {
+        Guard guard(mutex_);
+        stale  = frame_;
+        frame_ = nullptr;
+    }
+    if (stale != nullptr) {
+        stale->release();
+    }
+}
+
+CameraNode::CameraNode(std::string id) : Node("camera", std::move(id)), count_(0), preview_(false), binary_image_(false), preview_options_{50, 320, 240, false, 0}, thread_(nullptr), source_(nullptr), frame_index_(0) {}
 
 CameraNode::~CameraNode() {
     onDestroy();
@@ -17,13 +64,44 @@ ma_err_t CameraNode::onCreate(const json& config) {
         preview_ = config["preview"].get<bool>();
     }
 
-    const std::string pipeline =
-        "libcamerasrc camera-name=/base/axi/pcie@120000/rp1/i2c@88000/ov5647@36 ! video/x-raw,width=1920,height=1080,framerate=30/1,format=RGBx ! videoconvert ! videoscale ! appsink";
-    capture_ = new cv2::VideoCapture(pipeline);
+    if (config.contains("image") && config["image"].is_string()) {
+        binary_image_ = config["image"].get<std::string>() == "binary";
+    }
+
+    if (config.contains("encode") && config["encode"].is_object()) {
+        preview_options_.quality = config["encode"].value("quality", preview_options_.quality);
+        preview_options_.width   = config["encode"].value("width", preview_options_.width);
+        preview_options_.height  = config["encode"].value("height", preview_options_.height);
+    }
+
+    if (config.contains("queue") && config["queue"].is_number_integer()) {
+        if (server_->setPublishLimit(id_, config["queue"].get<int32_t>()) != MA_OK) {
+            MA_THROW(Exception(MA_EINVAL, "invalid queue: " + std::to_string(config["queue"].get<int32_t>())));
+        }
+    }
+
+    if (config.contains("format") && config["format"].is_string()) {
+        if (server_->setFormat(id_, config["format"].get<std::string>()) != MA_OK) {
+            MA_THROW(Exception(MA_EINVAL, "unknown format: " + config["format"].get<std::string>()));
+        }
+    }
 
-    if (capture_->isOpened()) {
-        server_->response(id_, json::object({{"type", MA_MSG_TYPE_RESP}, {"name", "create"}, {"code", MA_OK}, {"data", {"width", 1280, "height", 960, "fps", 30}}}));
+    MA_TRY {
+        source_ = FrameSource::create(config);
+    }
+    MA_CATCH(ma::Exception & e) {
+        MA_THROW(e);
+    }
+    MA_CATCH(std::exception & e) {
+        MA_THROW(Exception(MA_EINVAL, e.what()));
+    }
+
+    if (source_->open()) {
+        allocFrames(source_->width(), source_->height());
+        server_->response(id_, json::object({{"type", MA_MSG_TYPE_RESP}, {"name", "create"}, {"code", MA_OK}, {"data", {{"width", source_->width()}, {"height", source_->height()}, {"fps", source_->fps()}}}}));
     } else {
+        delete source_;
+        source_ = nullptr;
         MA_THROW(Exception(MA_EINVAL, "camera open failed"));
     }
 
@@ -56,6 +134,13 @@ ma_err_t CameraNode::onDestroy() {
         thread_ = nullptr;
     }
 
+    if (source_ != nullptr) {
+        delete source_;
+        source_ = nullptr;
+    }
+
+    freeFrames();
+
     created_ = false;
 
     return MA_OK;
@@ -66,6 +151,9 @@ ma_err_t CameraNode::onStart() {
     if (started_) {
         return MA_OK;
     }
+    if (!source_->isOpened() && !source_->open()) {
+        MA_THROW(Exception(MA_EIO, "camera open failed"));
+    }
     started_ = true;
     if (thread_ != nullptr) {
         thread_->start(this);
@@ -83,36 +171,156 @@ ma_err_t CameraNode::onStop() {
         thread_->join();
     }
 
-    capture_->release();
+    // a pending preview still references a pool slot and this node
+    JpegEncoder::instance()->cancel(this);
+
+    source_->close();
     return MA_OK;
 }
 
+ma_err_t CameraNode::allocFrames(int width, int height) {
+    freeFrames();
+
+    if (width <= 0 || height <= 0) {
+        width  = 1920;
+        height = 1080;
+    }
+
+    for (int i = 0; i < CAMERA_FRAME_POOL_SIZE; i++) {
+        videoFrame* frame = new videoFrame();
+        frame->pooled     = true;
+        frame->img.width  = width;
+        frame->img.height = height;
+        frame->img.size   = width * height * 3;
+        frame->img.format = MA_PIXEL_FORMAT_RGB888;  // channel order follows OpenCV (BGR)
+        frame->img.rotate = MA_PIXEL_ROTATE_0;
+        frame->img.data   = new uint8_t[frame->img.size];
+        frames_.push_back(frame);
+    }
+    frame_index_ = 0;
+
+    MA_LOGI(TAG, "frame pool: %d x %dx%d", CAMERA_FRAME_POOL_SIZE, width, height);
+
+    return MA_OK;
+}
+
+void CameraNode::freeFrames() {
+    for (auto& frame : frames_) {
+        if (!frame->idle()) {
+            MA_LOGW(TAG, "frame %p still referenced: %d", frame, frame->ref_cnt.load());
+        }
+        delete[] frame->img.data;
+        delete frame;
+    }
+    frames_.clear();
+}
+
+videoFrame* CameraNode::acquireFrame() {
+    for (size_t i = 0; i < frames_.size(); i++) {
+        videoFrame* frame = frames_[frame_index_];
+        frame_index_      = (frame_index_ + 1) % frames_.size();
+        if (frame->idle()) {
+            return frame;
+        }
+    }
+    return nullptr;
+}
+
 void CameraNode::threadEntry() {
-    cv2::Mat frame;
+    cv2::Mat image;
 
     while (started_) {
-        if (capture_->read(frame)) {
+        // consumers over their rate turn the frame away here, with nobody taking it the capture is only grabbed
+        admitted_.clear();
+        {
+            Guard guard(mailboxes_mutex_);
+            ma_tick_t now = Tick::current();
+            for (auto& mailbox : mailboxes_) {
+                if (mailbox->admit(now)) {
+                    admitted_.push_back(mailbox);
+                }
+            }
+        }
+        if (admitted_.empty() && !preview_) {
+            if (!source_->grab()) {
+                Thread::sleep(Tick::fromMilliseconds(10));
+            }
+            continue;
+        }
+
+        videoFrame* frame = acquireFrame();
+        if (frame == nullptr) {
+            // every slot is still held by a consumer, drop this capture
+            source_->grab();
+            continue;
+        }
+
+        image = cv2::Mat(frame->img.height, frame->img.width, CV_8UC3, frame->img.data);
+        if (!source_->read(image)) {
+            Thread::sleep(Tick::fromMilliseconds(10));  // end of a non looping file, or the device went away
+            continue;
+        }
 
-            for (auto& msgbox : msgboxes) {
-                msgbox->post(&frame, Tick::fromMilliseconds(static_cast<int>(30)));
+        if (image.data != frame->img.data) {
+            // the backend delivered another geometry than advertised, resize this slot once and keep going
+            MA_LOGW(TAG, "frame geometry changed: %dx%d -> %dx%d", frame->img.width, frame->img.height, image.cols, image.rows);
+            delete[] frame->img.data;
+            frame->img.width  = image.cols;
+            frame->img.height = image.rows;
+            frame->img.size   = image.cols * image.rows * 3;
+            frame->img.data   = new uint8_t[frame->img.size];
+            cv2::Mat slot(frame->img.height, frame->img.width, CV_8UC3, frame->img.data);
+            if (image.channels() == 4) {
+                cv2::cvtColor(image, slot, cv2::COLOR_BGRA2BGR);
+            } else {
+                image.copyTo(slot);
             }
+            image = slot;
+        }
 
-            if (preview_) {
-                cv2::Mat preview;
-                std::vector<uchar> buffer_;
-                cv2::resize(frame, preview, cv2::Size(320, 240), 0, 0, cv2::INTER_LINEAR);
-                std::vector<int> params_ = {cv2::IMWRITE_JPEG_QUALITY, 50};
-                cv2::imencode(".jpg", preview, buffer_, params_);
-                // convert to base64
-                char* base64_data = new char[4 * ((buffer_.size() + 2) / 3) + 2];
-                int base64_len    = buffer_.size() * 4 / 3 + 10;
-                ma::utils::base64_encode(reinterpret_cast<unsigned char*>(buffer_.data()), buffer_.size(), base64_data, &base64_len);
-                json reply             = json::object({{"type", MA_MSG_TYPE_EVT}, {"name", "sample"}, {"code", MA_OK}, {"data", {{"count", count_}}}});
-                reply["data"]["image"] = std::string(base64_data, base64_len);
-                delete[] base64_data;
-                server_->response(id_, reply);
+        count_++;
+        frame->timestamp = Tick::current();
+        frame->sequence  = count_;
+
+        // one reference per admitting consumer still attached, plus one held by this loop until preview is done
+        // a consumer that is behind loses its pending frame instead of stalling the capture
+        {
+            Guard guard(mailboxes_mutex_);
+            int posted = 0;
+            for (auto& mailbox : mailboxes_) {
+                posted += std::find(admitted_.begin(), admitted_.end(), mailbox) != admitted_.end();
+            }
+            frame->ref(posted + 1);
+            for (auto& mailbox : mailboxes_) {
+                if (std::find(admitted_.begin(), admitted_.end(), mailbox) != admitted_.end()) {
+                    mailbox->post(frame);
+                }
             }
         }
+
+        if (preview_) {
+            // hand the frame to the encoder pool, skipped while the previous preview is still encoding
+            const uint32_t count         = count_;
+            const bool binary            = binary_image_;
+            JpegEncoder::Options options = preview_options_;
+            options.header               = binary ? NODE_PUBLISH_HEADER : 0;
+            JpegEncoder::instance()->submit(this, frame, options, [this, count, binary](std::vector<uint8_t>& jpeg) {
+                if (jpeg.empty()) {
+                    return;
+                }
+                json reply = json::object({{"type", MA_MSG_TYPE_EVT}, {"name", "sample"}, {"code", MA_OK}, {"data", {{"count", count}}}});
+                if (binary) {
+                    // raw JPEG on the side topic, correlated by count
+                    server_->publish(id_, "image", count, std::move(jpeg));
+                    reply["data"]["image"] = "";
+                } else {
+                    reply["data"]["image"] = JpegEncoder::base64(jpeg);
+                }
+                server_->response(id_, std::move(reply));
+            });
+        }
+
+        frame->release();
     }
 }
 void CameraNode::threadEntryStub(void* obj) {
@@ -120,16 +328,16 @@ void CameraNode::threadEntryStub(void* obj) {
     node->threadEntry();
 }
 
-ma_err_t CameraNode::attach(MessageBox* msgbox) {
-    Guard guard(mutex_);
-    msgboxes.push_back(msgbox);
+ma_err_t CameraNode::attach(FrameMailbox* mailbox) {
+    Guard guard(mailboxes_mutex_);
+    mailboxes_.push_back(mailbox);
     return MA_OK;
 }
-ma_err_t CameraNode::detach(MessageBox* msgbox) {
-    Guard gurad(mutex_);
-    auto it = std::find(msgboxes.begin(), msgboxes.end(), msgbox);
-    if (it != msgboxes.end()) {
-        msgboxes.erase(it);
+ma_err_t CameraNode::detach(FrameMailbox* mailbox) {
+    Guard guard(mailboxes_mutex_);
+    auto it = std::find(mailboxes_.begin(), mailboxes_.end(), mailbox);
+    if (it != mailboxes_.end()) {
+        mailboxes_.erase(it);
     }
     return MA_OK;
 }
@@ -4,14 +4,17 @@
 
 namespace cv2 = cv;
 
+#include "encoder.h"
 #include "node.h"
+#include "rate.h"
 #include "server.h"
+#include "source.h"
 
 namespace ma::node {
 
 class videoFrame {
 public:
-    videoFrame() : ref_cnt(0), base64(nullptr), base64_len(0), timestamp(0) {
+    videoFrame() : ref_cnt(0), base64(nullptr), base64_len(0), timestamp(0), sequence(0), pooled(false) {
         memset(&img, 0, sizeof(ma_img_t));
     }
     ~videoFrame() = default;
@@ -20,6 +23,9 @@ public:
     }
     inline void release() {
         if (ref_cnt.load(std::memory_order_relaxed) == 0 || ref_cnt.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            if (pooled) {
+                return;  // storage belongs to the camera pool, the slot is free again
+            }
             if (!img.physical) {
                 delete[] img.data;
                 if (base64) {
@@ -29,13 +35,51 @@ public:
             delete this;
         }
     }
-    ma_tick_t timestamp;
+    inline bool idle() const {
+        return ref_cnt.load(std::memory_order_acquire) == 0;
+    }
+    ma_tick_t timestamp;  // capture, monotonic
+    uint32_t sequence;    // capture count of the camera
     std::atomic<int> ref_cnt;
     char* base64;
     int base64_len;
+    bool pooled;
     ma_img_t img;
 };
 
+// Latest-frame-wins hand-off from the camera to one consumer. post() never blocks: a frame the consumer
+// has not fetched yet is released and replaced, so a slow consumer always gets the freshest capture.
+class FrameMailbox {
+public:
+    FrameMailbox();
+    ~FrameMailbox();
+
+    // takes over one reference of the frame
+    void post(videoFrame* frame);
+    bool fetch(videoFrame** frame, ma_tick_t timeout);
+    // releases the pending frame, if any
+    void clear();
+
+    // the consumer's admission control, asked by the camera before a capture is decoded for it; not owned
+    void setGate(RateController* gate) {
+        gate_ = gate;
+    }
+    bool admit(ma_tick_t now) {
+        return gate_ == nullptr || gate_->admit(now);
+    }
+
+    // frames replaced before they were fetched
+    uint32_t dropped() const {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+private:
+    Mutex mutex_;
+    Semaphore sem_;
+    videoFrame* frame_;
+    RateController* gate_;
+    std::atomic<uint32_t> dropped_;
+};
 
 class CameraNode : public Node {
 public:
@@ -48,20 +92,30 @@ public:
     ma_err_t onStop() override;
     ma_err_t onDestroy() override;
 
-    ma_err_t attach(MessageBox* msgbox);
-    ma_err_t detach(MessageBox* msgbox);
+    ma_err_t attach(FrameMailbox* mailbox);
+    ma_err_t detach(FrameMailbox* mailbox);
 
 protected:
     void threadEntry();
     static void threadEntryStub(void* obj);
 
+    ma_err_t allocFrames(int width, int height);
+    void freeFrames();
+    videoFrame* acquireFrame();
+
 private:
     uint32_t count_;
     bool preview_;
+    bool binary_image_;
+    JpegEncoder::Options preview_options_;
     int option_;
     Thread* thread_;
-    cv2::VideoCapture* capture_;
-    std::vector<MessageBox*> msgboxes;
+    FrameSource* source_;
+    std::vector<videoFrame*> frames_;
+    size_t frame_index_;
+    Mutex mailboxes_mutex_;  // not mutex_, onStop holds that one while joining the capture loop
+    std::vector<FrameMailbox*> mailboxes_;
+    std::vector<FrameMailbox*> admitted_;  // capture loop scratch, the mailboxes taking the current frame
 };
 
 }  // namespace ma::node
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "emitter.h"
+
+namespace ma::node {
+
+ChangeEmitter::ChangeEmitter() : enabled_(false), tolerance_(0.02f), score_(0.1f), keyframe_(0), last_keyframe_(0), pending_(true), next_key_(-1) {}
+
+void ChangeEmitter::configure(bool enabled, float tolerance, int32_t score, int32_t keyframe) {
+    Guard guard(mutex_);
+    enabled_   = enabled;
+    tolerance_ = std::max(tolerance, 0.0f);
+    score_     = std::max(score, 0) / 100.0f;
+    keyframe_  = Tick::fromMilliseconds(std::max(keyframe, 0));
+    pending_   = true;
+}
+
+void ChangeEmitter::reset() {
+    Guard guard(mutex_);
+    pending_ = true;
+}
+
+bool ChangeEmitter::apply(std::vector<Item>& items, ma_tick_t now, bool& keyframe, std::vector<size_t>& added, std::vector<size_t>& updated, std::vector<int32_t>& removed) {
+    Guard guard(mutex_);
+
+    added.clear();
+    updated.clear();
+    removed.clear();
+
+    // match every item to what was sent, by track id or else by the nearest untracked object of its class
+    taken_.assign(state_.size(), 0);
+    std::vector<int32_t>& matched = matched_;
+    matched.assign(items.size(), -1);
+    for (size_t i = 0; i < items.size(); i++) {
+        Item& item = items[i];
+        if (item.track >= 0) {
+            item.key = item.track;
+            for (size_t s = 0; s < state_.size(); s++) {
+                if (!taken_[s] && state_[s].key == item.key) {
+                    matched[i] = s;
+                    taken_[s]  = 1;
+                    break;
+                }
+            }
+            continue;
+        }
+        float best = std::numeric_limits<float>::max();
+        for (size_t s = 0; s < state_.size(); s++) {
+            const Item& sent = state_[s];
+            if (taken_[s] || sent.key >= 0 || sent.target != item.target) {
+                continue;
+            }
+            float distance = std::hypot(item.x - sent.x, item.y - sent.y);
+            if (distance <= std::max(sent.w, sent.h) / 2 + tolerance_ && distance < best) {
+                best       = distance;
+                matched[i] = s;
+            }
+        }
+        if (matched[i] >= 0) {
+            item.key           = state_[matched[i]].key;
+            taken_[matched[i]] = 1;
+        } else {
+            item.key  = next_key_;
+            next_key_ = next_key_ == std::numeric_limits<int32_t>::min() ? -1 : next_key_ - 1;
+        }
+    }
+
+    keyframe = !enabled_ || pending_ || (keyframe_ > 0 && now - last_keyframe_ >= keyframe_);
+    if (keyframe) {
+        state_         = items;
+        last_keyframe_ = now;
+        pending_       = false;
+        return true;
+    }
+
+    // sized by the counts up front, the first frame where everything is added or updated does not allocate later
+    std::vector<Item>& next = next_;
+    next.clear();
+    next.reserve(items.size() + state_.size());
+    added.reserve(items.size());
+    updated.reserve(items.size());
+    removed.reserve(state_.size());
+    for (size_t i = 0; i < items.size(); i++) {
+        const Item& item = items[i];
+        if (matched[i] < 0) {
+            added.push_back(i);
+            next.push_back(item);
+            continue;
+        }
+        // compared with the state as sent, so a slow drift adds up until it is reported
+        const Item& sent = state_[matched[i]];
+        bool moved       = std::fabs(item.x - sent.x) > tolerance_ || std::fabs(item.y - sent.y) > tolerance_;
+        bool resized     = std::fabs(item.w - sent.w) > tolerance_ || std::fabs(item.h - sent.h) > tolerance_;
+        if (moved || resized || item.target != sent.target || std::fabs(item.score - sent.score) > score_) {
+            updated.push_back(i);
+            next.push_back(item);
+        } else {
+            next.push_back(sent);
+        }
+    }
+    for (size_t s = 0; s < state_.size(); s++) {
+        if (!taken_[s]) {
+            removed.push_back(state_[s].key);
+        }
+    }
+    state_.swap(next);
+
+    return !added.empty() || !updated.empty() || !removed.empty();
+}
+
+}  // namespace ma::node
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "core/ma_core.h"
+#include "porting/ma_osal.h"
+
+#include "node.h"
+
+namespace ma::node {
+
+// Publish-on-change for the results of a model node. Every object gets a key (its track id, or a
+// negative key kept by nearest same-class match when it is not tracked) and is compared with the state
+// last sent: only objects that appeared, vanished, moved or resized by more than the tolerance, or whose
+// score moved by more than the score tolerance go out, with a keyframe carrying the full state every so often.
+class ChangeEmitter {
+public:
+    struct Item {
+        int32_t track;  // -1 when not tracked
+        int32_t key;    // filled by apply()
+        int32_t target;
+        float x;  // 0..1 of the model input, centre based
+        float y;
+        float w;
+        float h;
+        float score;
+    };
+
+    ChangeEmitter();
+    ~ChangeEmitter() = default;
+
+    // tolerance: 0..1 of the model input, score: percent points, keyframe: ms between full states, 0 only the first
+    void configure(bool enabled, float tolerance, int32_t score, int32_t keyframe);
+
+    // the next frame is a keyframe
+    void reset();
+
+    // keys the items; on a keyframe returns true with keyframe set, otherwise fills delta with the indices of
+    // added and updated items and the keys of removed ones and returns whether there is any
+    bool apply(std::vector<Item>& items, ma_tick_t now, bool& keyframe, std::vector<size_t>& added, std::vector<size_t>& updated, std::vector<int32_t>& removed);
+
+private:
+    Mutex mutex_;
+    bool enabled_;
+    float tolerance_;
+    float score_;
+    ma_tick_t keyframe_;
+    ma_tick_t last_keyframe_;
+    bool pending_;  // keyframe due regardless of time
+    int32_t next_key_;
+    std::vector<Item> state_;     // as last sent
+    std::vector<uint8_t> taken_;  // scratch, reused between frames
+    std::vector<int32_t> matched_;
+    std::vector<Item> next_;
+};
+
+}  // namespace ma::node
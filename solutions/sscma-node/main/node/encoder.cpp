@@ -0,0 +1,222 @@
+#include <algorithm>
+
+#include "camera.h"
+#include "encoder.h"
+
+namespace ma::node {
+
+static constexpr char TAG[] = "ma::node::encoder";
+
+// shared by every node, encodes of different nodes run in parallel
+#define ENCODER_WORKERS 2
+
+// pending requests across all owners, a further request is skipped
+#define ENCODER_QUEUE_DEPTH 4
+
+JpegEncoder::JpegEncoder(size_t workers) : signal_(0), finished_(0), cancelling_(0), running_(true) {
+    for (size_t i = 0; i < workers; i++) {
+        names_.push_back("encoder#" + std::to_string(i));
+    }
+    for (auto& name : names_) {
+        Thread* thread = new Thread(name.c_str(), &JpegEncoder::threadEntryStub, this);
+        if (thread == nullptr || !thread->start(this)) {
+            MA_LOGE(TAG, "worker start failed: %s", name.c_str());
+            delete thread;
+            continue;
+        }
+        threads_.push_back(thread);
+    }
+}
+
+JpegEncoder::~JpegEncoder() {
+    running_.store(false);
+    for (size_t i = 0; i < threads_.size(); i++) {
+        signal_.signal();
+    }
+    for (auto& thread : threads_) {
+        thread->join();
+        delete thread;
+    }
+    for (auto& request : queue_) {
+        if (request.frame != nullptr) {
+            request.frame->release();
+        }
+    }
+}
+
+JpegEncoder* JpegEncoder::instance() {
+    static JpegEncoder encoder(ENCODER_WORKERS);
+    return &encoder;
+}
+
+bool JpegEncoder::submit(const void* owner, videoFrame* frame, const Options& options, callback_t callback) {
+    frame->ref();
+    if (!push({owner, frame, cv2::Mat(), options, std::move(callback)})) {
+        frame->release();
+        return false;
+    }
+    return true;
+}
+
+bool JpegEncoder::submit(const void* owner, const cv2::Mat& image, const Options& options, callback_t callback) {
+    return push({owner, nullptr, image, options, std::move(callback)});
+}
+
+bool JpegEncoder::push(Request&& request) {
+    {
+        Guard guard(mutex_);
+        auto owner = owners_.find(request.owner);
+        if (owner != owners_.end()) {
+            // skipped, but a result sent now would overtake the one waiting for its image
+            MA_LOGV(TAG, "skip: %p", request.owner);
+            owner->second.push_back(std::move(request.callback));
+            return false;
+        }
+        if (!threads_.empty() && queue_.size() < ENCODER_QUEUE_DEPTH) {
+            owners_[request.owner];
+            queue_.push_back(std::move(request));
+            signal_.signal();
+            return true;
+        }
+    }
+
+    // saturated, the caller goes on without an image
+    MA_LOGV(TAG, "skip: %p", request.owner);
+    std::vector<uint8_t> empty;
+    request.callback(empty);
+    return false;
+}
+
+void JpegEncoder::cancel(const void* owner) {
+    {
+        Guard guard(mutex_);
+        for (auto it = queue_.begin(); it != queue_.end();) {
+            if (it->owner == owner) {
+                if (it->frame != nullptr) {
+                    it->frame->release();
+                }
+                it = queue_.erase(it);
+                owners_.erase(owner);
+                for (; cancelling_ > 0; cancelling_--) {
+                    finished_.signal();
+                }
+            } else {
+                ++it;
+            }
+        }
+        auto it = owners_.find(owner);
+        if (it != owners_.end()) {
+            it->second.clear();
+        }
+    }
+
+    // the running callback may still touch the owner, a worker wakes us when any owner finishes
+    while (true) {
+        {
+            Guard guard(mutex_);
+            if (owners_.count(owner) == 0) {
+                break;
+            }
+            cancelling_++;
+        }
+        finished_.wait();
+    }
+}
+
+std::string JpegEncoder::base64(const std::vector<uint8_t>& jpeg) {
+    if (jpeg.empty()) {
+        return "";
+    }
+    char* base64_data = new char[4 * ((jpeg.size() + 2) / 3) + 2];
+    int base64_len    = jpeg.size() * 4 / 3 + 10;
+    ma::utils::base64_encode(jpeg.data(), jpeg.size(), base64_data, &base64_len);
+    std::string result(base64_data, base64_len);
+    delete[] base64_data;
+    return result;
+}
+
+void JpegEncoder::threadEntry() {
+    // per worker scratch, reused across requests
+    cv2::Mat scaled;
+    cv2::Mat converted;
+    std::vector<uint8_t> encoded;  // imencode grows its output chunk by chunk, a kept one has the capacity already
+    std::vector<int> params = {cv2::IMWRITE_JPEG_QUALITY, 0};
+
+    while (running_.load()) {
+        if (!signal_.wait(Tick::fromSeconds(1))) {
+            continue;
+        }
+
+        Request request;
+        {
+            Guard guard(mutex_);
+            if (queue_.empty()) {
+                continue;
+            }
+            request = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        cv2::Mat image = request.image;
+        if (request.frame != nullptr) {
+            image = cv2::Mat(request.frame->img.height, request.frame->img.width, CV_8UC3, request.frame->img.data);
+        }
+
+        // shrink first, the conversion then runs on fewer pixels
+        if (request.options.width > 0 && request.options.height > 0 && (request.options.width != image.cols || request.options.height != image.rows)) {
+            cv2::resize(image, scaled, cv2::Size(request.options.width, request.options.height), 0, 0, cv2::INTER_LINEAR);
+            image = scaled;
+        }
+        if (request.options.rgb) {
+            cv2::cvtColor(image, converted, cv2::COLOR_RGB2BGR);
+            image = converted;
+        }
+
+        // imencode always writes from the start of its buffer, the JPEG is copied once behind the header
+        std::vector<uint8_t> jpeg;
+        params[1] = std::clamp(request.options.quality, 0, 100);
+        if (cv2::imencode(".jpg", image, encoded, params)) {
+            jpeg.reserve(request.options.header + encoded.size());
+            jpeg.resize(request.options.header);
+            jpeg.insert(jpeg.end(), encoded.begin(), encoded.end());
+        } else {
+            MA_LOGW(TAG, "encode failed: %p", request.owner);
+        }
+
+        // give the pixels back before the callback publishes
+        image         = cv2::Mat();
+        request.image = cv2::Mat();
+        if (request.frame != nullptr) {
+            request.frame->release();
+            request.frame = nullptr;
+        }
+
+        request.callback(jpeg);
+
+        // then the requests of this owner skipped meanwhile, in order, before it may submit again
+        while (true) {
+            callback_t skipped;
+            {
+                Guard guard(mutex_);
+                auto owner = owners_.find(request.owner);
+                if (owner == owners_.end() || owner->second.empty()) {
+                    owners_.erase(request.owner);
+                    for (; cancelling_ > 0; cancelling_--) {
+                        finished_.signal();
+                    }
+                    break;
+                }
+                skipped = std::move(owner->second.front());
+                owner->second.pop_front();
+            }
+            jpeg.clear();
+            skipped(jpeg);
+        }
+    }
+}
+
+void JpegEncoder::threadEntryStub(void* obj) {
+    static_cast<JpegEncoder*>(obj)->threadEntry();
+}
+
+}  // namespace ma::node
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+namespace cv2 = cv;
+
+#include "core/ma_core.h"
+#include "porting/ma_osal.h"
+
+namespace ma::node {
+
+class videoFrame;
+
+// Shared JPEG encoder service for preview and debug images.
+// Capture and inference loops only hand over a frame reference, a small pool of workers does the
+// resize / color conversion / imencode. Each owner has at most one request in flight, further
+// submissions are skipped until it completes, so a slow encoder lowers the image rate instead of the FPS.
+// The callbacks of an owner still run in submission order, a skipped one waits for the one in flight.
+class JpegEncoder {
+public:
+    struct Options {
+        int quality;    // 0..100
+        int width;      // 0 keeps the source size
+        int height;     // 0 keeps the source size
+        bool rgb;       // source is RGB instead of the OpenCV BGR order
+        size_t header;  // bytes left free in front of the JPEG for the caller to fill, e.g. a publish header
+    };
+
+    // runs on a worker, with an empty buffer when the request was skipped or failed: inline when the owner had
+    // nothing in flight, otherwise right after the callback of the request in flight
+    typedef std::function<void(std::vector<uint8_t>& jpeg)> callback_t;
+
+    static JpegEncoder* instance();
+
+    // the frame is referenced until encoded, the image shares its pixels (check refcount before writing to it again)
+    bool submit(const void* owner, videoFrame* frame, const Options& options, callback_t callback);
+    bool submit(const void* owner, const cv2::Mat& image, const Options& options, callback_t callback);
+
+    // drop queued requests of owner and wait for the running one, callbacks never fire afterwards
+    void cancel(const void* owner);
+
+    static std::string base64(const std::vector<uint8_t>& jpeg);
+
+protected:
+    JpegEncoder(size_t workers);
+    ~JpegEncoder();
+
+    struct Request {
+        const void* owner;
+        videoFrame* frame;
+        cv2::Mat image;
+        Options options;
+        callback_t callback;
+    };
+
+    bool push(Request&& request);
+    void threadEntry();
+    static void threadEntryStub(void* obj);
+
+private:
+    Mutex mutex_;
+    Semaphore signal_;
+    Semaphore finished_;  // an owner's request and callbacks are done, one signal per cancel() waiting
+    size_t cancelling_;   // cancel() calls waiting on finished_, under mutex_
+    std::atomic<bool> running_;
+    std::deque<Request> queue_;
+    std::unordered_map<const void*, std::deque<callback_t>> owners_;  // queued or being encoded, and the callbacks skipped behind it
+    std::vector<std::string> names_;
+    std::vector<Thread*> threads_;
+};
+
+}  // namespace ma::node
@@ -1,87 +1,189 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
+#include <deque>
 #include <functional>
 #include <memory>
-#include <queue>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
+#include <vector>
 
 #include "core/ma_common.h"
 #include "porting/ma_osal.h"
 
 namespace ma::node {
 
+// return true to have the task retried later (e.g. MA_AGAIN)
 typedef std::function<bool(void)> task_t;
 
+// Worker pool for control plane requests.
+// Tasks sharing a key run one at a time in submission order, tasks with different keys run concurrently
+// and the highest priority runnable head goes first. Exclusive tasks run alone. Retries back off
+// exponentially instead of being resubmitted immediately.
 class Executor {
 public:
-    Executor(std::size_t stack_size = 0, std::size_t priority = 0) : _task_queue_lock(), _task_queue_signal(0), _worker_name(MA_EXECUTOR_WORKER_NAME_PREFIX), _worker_handler() {
+    static constexpr int PRIORITY_NORMAL = 0;
+    static constexpr int PRIORITY_HIGH   = 1;
+
+    Executor(std::size_t workers = 2, std::size_t stack_size = 0, std::size_t priority = 0)
+        : _task_queue_lock(), _task_queue_signal(0), _running(true), _exclusive(false), _sequence(0), _worker_handlers() {
         static uint8_t worker_id        = 0u;
         static const char* hex_literals = "0123456789ABCDEF";
 
-        worker_id++;
+        workers = std::max<std::size_t>(workers, 1);
+
+        for (std::size_t i = 0; i < workers; ++i) {
+            worker_id++;
 
-        // prepare worker name (FreeRTOS task required), reserve 2 bytes for uint8_t hex string
-        _worker_name.reserve(_worker_name.length() + (sizeof(uint8_t) << 1) + 1);
+            // prepare worker name (FreeRTOS task required), reserve 2 bytes for uint8_t hex string
+            std::string name(MA_EXECUTOR_WORKER_NAME_PREFIX);
+            name.reserve(name.length() + (sizeof(uint8_t) << 1) + 1);
 
-        // convert worker id to hex string
-        _worker_name += hex_literals[worker_id >> 4];
-        _worker_name += hex_literals[worker_id & 0x0f];
+            // convert worker id to hex string
+            name += hex_literals[worker_id >> 4];
+            name += hex_literals[worker_id & 0x0f];
+            _worker_names.push_back(std::move(name));
+        }
 
-        _worker_handler = new Thread(_worker_name.c_str(), &Executor::c_run, this, priority, stack_size);
-        MA_ASSERT(_worker_handler);
+        for (auto& name : _worker_names) {
+            Thread* worker = new Thread(name.c_str(), &Executor::c_run, this, priority, stack_size);
+            MA_ASSERT(worker);
 
-        if (!_worker_handler->start(this)) {
-            delete _worker_handler;
-            MA_ASSERT(false);
+            if (!worker->start(this)) {
+                delete worker;
+                MA_ASSERT(false);
+            }
+            _worker_handlers.push_back(worker);
         }
     }
 
     ~Executor() {
         cancel();
-        _worker_handler->stop();
-        delete _worker_handler;
+        _running.store(false);
+        for (std::size_t i = 0; i < _worker_handlers.size(); ++i) {
+            _task_queue_signal.signal();
+        }
+        for (auto& worker : _worker_handlers) {
+            worker->join();
+            delete worker;
+        }
     }
 
     // the Callable must be a function object or a lambda, the prototype is task_t
     template <typename Callable>
     inline void submit(Callable&& callable) {
+        submit(std::string(), std::forward<Callable>(callable));
+    }
+
+    template <typename Callable>
+    inline void submit(const std::string& key, Callable&& callable, int priority = PRIORITY_NORMAL, bool exclusive = false) {
         {
             Guard guard(_task_queue_lock);
-            _task_queue.push(std::forward<Callable>(callable));
+            _task_queues[key].push_back({task_t(std::forward<Callable>(callable)), priority, exclusive, _sequence++, 0, 0});
         }
         _task_queue_signal.signal();
     }
 
-
     inline void cancel() {
         Guard guard(_task_queue_lock);
-        while (!_task_queue.empty())
-            _task_queue.pop();
+        _task_queues.clear();
     }
 
 protected:
+    struct Task {
+        task_t callable;
+        int priority;
+        bool exclusive;
+        uint64_t sequence;
+        uint32_t retries;
+        ma_tick_t due;
+    };
+
+    // 10ms, 20ms, 40ms ... capped at 1s
+    static ma_tick_t backoff(uint32_t retries) {
+        return Tick::fromMilliseconds(std::min<uint32_t>(1000u, 10u << std::min<uint32_t>(retries - 1, 7u)));
+    }
+
+    // pick the best runnable queue head, must hold _task_queue_lock
+    bool take(Task& task, std::string& key, ma_tick_t& wait) {
+        const ma_tick_t now         = Tick::current();
+        Task* best                  = nullptr;
+        const std::string* best_key = nullptr;
+
+        if (_exclusive) {
+            return false;
+        }
+
+        for (auto& queue : _task_queues) {
+            if (queue.second.empty() || _busy.count(queue.first)) {
+                continue;
+            }
+            Task& head = queue.second.front();
+            if (head.due > now) {
+                wait = std::min(wait, head.due - now);
+                continue;
+            }
+            if (head.exclusive && !_busy.empty()) {
+                continue;
+            }
+            if (best == nullptr || head.priority > best->priority || (head.priority == best->priority && head.sequence < best->sequence)) {
+                best     = &head;
+                best_key = &queue.first;
+            }
+        }
+
+        if (best == nullptr) {
+            return false;
+        }
+
+        key     = *best_key;
+        task    = std::move(*best);
+        auto it = _task_queues.find(key);
+        it->second.pop_front();
+        if (it->second.empty()) {
+            _task_queues.erase(it);
+        }
+        _busy.insert(key);
+        _exclusive = task.exclusive;
+        return true;
+    }
+
     void run() {
-        while (true) {
-            task_t task{};
+        while (_running.load()) {
+            Task task{};
+            std::string key;
+            ma_tick_t wait = Tick::fromMilliseconds(100);
+            bool taken     = false;
+
             {
-                Thread::sleep(Tick::fromMilliseconds(20)); // advoid race condition
-                _task_queue_signal.wait();
-                {
-                    Guard guard(_task_queue_lock);
-                    if (!_task_queue.empty()) [[likely]] {
-                        task = std::move(_task_queue.front());
-                        _task_queue.pop();
-                    }
-                }
-                if (task) [[unlikely]] {
-                    if (task()) {
-                        submit(std::move(task));  // push task back into queue
-                    }
+                Guard guard(_task_queue_lock);
+                taken = take(task, key, wait);
+            }
+
+            if (!taken) [[unlikely]] {
+                _task_queue_signal.wait(wait);
+                continue;
+            }
+
+            bool again = task.callable();
+
+            {
+                Guard guard(_task_queue_lock);
+                _busy.erase(key);
+                _exclusive = false;
+                if (again && _running.load()) {
+                    // keep its place at the head so later requests for the same key stay ordered
+                    task.retries++;
+                    task.due = Tick::current() + backoff(task.retries);
+                    _task_queues[key].push_front(std::move(task));
                 }
             }
-            Thread::yield();
+
+            // the key is free again, let another worker look at the queue
+            _task_queue_signal.signal();
         }
     }
 
@@ -92,10 +194,14 @@ protected:
 private:
     Mutex _task_queue_lock;
     Semaphore _task_queue_signal;
-    std::string _worker_name;
-    Thread* _worker_handler;
-
-    std::queue<task_t> _task_queue;
+    std::atomic<bool> _running;
+    bool _exclusive;
+    uint64_t _sequence;
+    std::vector<std::string> _worker_names;
+    std::vector<Thread*> _worker_handlers;
+
+    std::unordered_map<std::string, std::deque<Task>> _task_queues;
+    std::unordered_set<std::string> _busy;
 };
 
 }  // namespace ma::node
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LETTERBOX_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define LETTERBOX_SSE2 1
+#endif
+
+#include "letterbox.h"
+
+namespace ma::node {
+
+#define LETTERBOX_COEF_BITS  7
+#define LETTERBOX_COEF_SCALE (1 << LETTERBOX_COEF_BITS)
+
+Letterbox::Letterbox(uint8_t pad) : pad_(pad), sw_(0), sh_(0), dw_(0), dh_(0), nw_(0), nh_(0), top_(0), left_(0), scale_(1.0f), cached_{-1, -1} {}
+
+void Letterbox::configure(int src_width, int src_height, int dst_width, int dst_height) {
+    if (src_width == sw_ && src_height == sh_ && dst_width == dw_ && dst_height == dh_) {
+        return;
+    }
+
+    sw_ = src_width;
+    sh_ = src_height;
+    dw_ = dst_width;
+    dh_ = dst_height;
+
+    // same geometry as the former resize + copyMakeBorder path
+    double resize_scale = std::min((double)dh_ / sh_, (double)dw_ / sw_);
+    nh_                 = std::max(1, (int)(sh_ * resize_scale));
+    nw_                 = std::max(1, (int)(sw_ * resize_scale));
+    top_                = (dh_ - nh_) / 2;
+    left_               = (dw_ - nw_) / 2;
+    scale_              = static_cast<float>(resize_scale);
+
+    // half pixel centers, like cv::resize INTER_LINEAR
+    const double fx = (double)sw_ / nw_;
+    xofs_.resize(nw_ * 2);
+    xalpha_.resize(nw_);
+    for (int x = 0; x < nw_; x++) {
+        double sx = (x + 0.5) * fx - 0.5;
+        int x0    = (int)std::floor(sx);
+        double a  = sx - x0;
+        if (x0 < 0) {
+            x0 = 0;
+            a  = 0;
+        }
+        if (x0 >= sw_ - 1) {
+            x0 = sw_ - 1;
+            a  = 0;
+        }
+        xofs_[x * 2]     = x0 * 3;
+        xofs_[x * 2 + 1] = std::min(x0 + 1, sw_ - 1) * 3;
+        xalpha_[x]       = static_cast<uint16_t>(std::lround(a * LETTERBOX_COEF_SCALE));
+    }
+
+    const double fy = (double)sh_ / nh_;
+    yofs_.resize(nh_ * 2);
+    yalpha_.resize(nh_);
+    for (int y = 0; y < nh_; y++) {
+        double sy = (y + 0.5) * fy - 0.5;
+        int y0    = (int)std::floor(sy);
+        double a  = sy - y0;
+        if (y0 < 0) {
+            y0 = 0;
+            a  = 0;
+        }
+        if (y0 >= sh_ - 1) {
+            y0 = sh_ - 1;
+            a  = 0;
+        }
+        yofs_[y * 2]     = y0;
+        yofs_[y * 2 + 1] = std::min(y0 + 1, sh_ - 1);
+        yalpha_[y]       = static_cast<uint16_t>(std::lround(a * LETTERBOX_COEF_SCALE));
+    }
+
+    rows_[0].resize(nw_ * 3);
+    rows_[1].resize(nw_ * 3);
+    cached_[0] = -1;
+    cached_[1] = -1;
+}
+
+void Letterbox::horizontal(const uint8_t* row, uint16_t* out) const {
+    const int32_t* ofs    = xofs_.data();
+    const uint16_t* alpha = xalpha_.data();
+    for (int x = 0; x < nw_; x++, out += 3) {
+        const uint8_t* p0 = row + ofs[x * 2];
+        const uint8_t* p1 = row + ofs[x * 2 + 1];
+        const uint16_t a1 = alpha[x];
+        const uint16_t a0 = LETTERBOX_COEF_SCALE - a1;
+        // BGR in, RGB out
+        out[0] = p0[2] * a0 + p1[2] * a1;
+        out[1] = p0[1] * a0 + p1[1] * a1;
+        out[2] = p0[0] * a0 + p1[0] * a1;
+    }
+}
+
+void Letterbox::vertical(const uint16_t* row0, const uint16_t* row1, uint16_t weight, uint8_t* out) const {
+    const int n       = nw_ * 3;
+    const uint16_t w1 = weight;
+    const uint16_t w0 = LETTERBOX_COEF_SCALE - weight;
+    int i             = 0;
+
+#if LETTERBOX_NEON
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t a  = vld1q_u16(row0 + i);
+        uint16x8_t b  = vld1q_u16(row1 + i);
+        uint32x4_t lo = vmull_n_u16(vget_low_u16(a), w0);
+        uint32x4_t hi = vmull_n_u16(vget_high_u16(a), w0);
+        lo            = vmlal_n_u16(lo, vget_low_u16(b), w1);
+        hi            = vmlal_n_u16(hi, vget_high_u16(b), w1);
+        uint16x8_t r  = vcombine_u16(vrshrn_n_u32(lo, LETTERBOX_COEF_BITS * 2), vrshrn_n_u32(hi, LETTERBOX_COEF_BITS * 2));
+        vst1_u8(out + i, vmovn_u16(r));
+    }
+#elif LETTERBOX_SSE2
+    const __m128i w     = _mm_set1_epi32(static_cast<int32_t>(w0) | (static_cast<int32_t>(w1) << 16));
+    const __m128i delta = _mm_set1_epi32(1 << (LETTERBOX_COEF_BITS * 2 - 1));
+    for (; i + 8 <= n; i += 8) {
+        __m128i a  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + i));
+        __m128i b  = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + i));
+        __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w);
+        __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w);
+        lo         = _mm_srai_epi32(_mm_add_epi32(lo, delta), LETTERBOX_COEF_BITS * 2);
+        hi         = _mm_srai_epi32(_mm_add_epi32(hi, delta), LETTERBOX_COEF_BITS * 2);
+        __m128i r  = _mm_packs_epi32(lo, hi);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(r, r));
+    }
+#endif
+
+    // scalar reference path, also handles the tail
+    for (; i < n; i++) {
+        out[i] = static_cast<uint8_t>((row0[i] * w0 + row1[i] * w1 + (1 << (LETTERBOX_COEF_BITS * 2 - 1))) >> (LETTERBOX_COEF_BITS * 2));
+    }
+}
+
+void Letterbox::run(const uint8_t* src, size_t src_stride, uint8_t* dst) {
+    const size_t dst_stride = static_cast<size_t>(dw_) * 3;
+
+    if (top_ > 0) {
+        memset(dst, pad_, dst_stride * top_);
+    }
+
+    for (int y = 0; y < nh_; y++) {
+        const int y0 = yofs_[y * 2];
+        const int y1 = yofs_[y * 2 + 1];
+
+        // keep the two most recent source rows, consecutive output rows mostly share them
+        if (cached_[0] != y0) {
+            if (cached_[1] == y0) {
+                std::swap(rows_[0], rows_[1]);
+                std::swap(cached_[0], cached_[1]);
+            } else {
+                horizontal(src + y0 * src_stride, rows_[0].data());
+                cached_[0] = y0;
+            }
+        }
+        if (cached_[1] != y1) {
+            horizontal(src + y1 * src_stride, rows_[1].data());
+            cached_[1] = y1;
+        }
+
+        uint8_t* out = dst + (top_ + y) * dst_stride;
+        if (left_ > 0) {
+            memset(out, pad_, left_ * 3);
+        }
+        vertical(rows_[0].data(), rows_[1].data(), yalpha_[y], out + left_ * 3);
+        if (left_ + nw_ < dw_) {
+            memset(out + (left_ + nw_) * 3, pad_, (dw_ - left_ - nw_) * 3);
+        }
+    }
+
+    if (top_ + nh_ < dh_) {
+        memset(dst + (top_ + nh_) * dst_stride, pad_, dst_stride * (dh_ - top_ - nh_));
+    }
+
+    // the source buffer changes every frame
+    cached_[0] = -1;
+    cached_[1] = -1;
+}
+
+}  // namespace ma::node
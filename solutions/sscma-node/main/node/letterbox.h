@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ma::node {
+
+// Fused resize + pad + BGR->RGB swizzle, writes the model input in a single pass over the output pixels.
+// Bilinear sampling uses 7 bit fixed point weights, the NEON/SSE2 and scalar paths produce identical bytes.
+class Letterbox {
+public:
+    Letterbox(uint8_t pad = 114);
+    ~Letterbox() = default;
+
+    // rebuild the sampling tables, cheap to call every frame when the geometry does not change
+    void configure(int src_width, int src_height, int dst_width, int dst_height);
+
+    // src: packed 3 channel BGR with a row stride in bytes, dst: dst_width * dst_height * 3 packed RGB
+    void run(const uint8_t* src, size_t src_stride, uint8_t* dst);
+
+    float scale() const {
+        return scale_;
+    }
+    int top() const {
+        return top_;
+    }
+    int left() const {
+        return left_;
+    }
+    int width() const {
+        return nw_;
+    }
+    int height() const {
+        return nh_;
+    }
+
+protected:
+    void horizontal(const uint8_t* row, uint16_t* out) const;
+    void vertical(const uint16_t* row0, const uint16_t* row1, uint16_t weight, uint8_t* out) const;
+
+private:
+    uint8_t pad_;
+    int sw_;
+    int sh_;
+    int dw_;
+    int dh_;
+    int nw_;
+    int nh_;
+    int top_;
+    int left_;
+    float scale_;
+    std::vector<int32_t> xofs_;     // byte offsets of both horizontal taps, 2 per output column
+    std::vector<uint16_t> xalpha_;  // weight of the right tap, 0..128
+    std::vector<int32_t> yofs_;     // source rows of both vertical taps, 2 per output row
+    std::vector<uint16_t> yalpha_;  // weight of the lower tap, 0..128
+    std::vector<uint16_t> rows_[2];
+    int cached_[2];
+};
+
+}  // namespace ma::node
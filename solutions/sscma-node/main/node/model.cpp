@@ -1,5 +1,10 @@
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
 #include <unistd.h>
 
+#include "ma_engine_factory.h"
+
 #include "model.h"
 
 namespace ma::node {
@@ -12,206 +17,959 @@ static constexpr char TAG[] = "ma::node::model";
 
 #define DEFAULT_MODEL "/usr/share/sscma-node/models/model.hef"
 
+// frames in flight between the pre-process, inference and publish stages
+#define MODEL_PIPELINE_DEPTH 3
+
+static float iou(const ma_bbox_t& a, const ma_bbox_t& b) {
+    float x1    = std::max(a.x - a.w / 2, b.x - b.w / 2);
+    float y1    = std::max(a.y - a.h / 2, b.y - b.h / 2);
+    float x2    = std::min(a.x + a.w / 2, b.x + b.w / 2);
+    float y2    = std::min(a.y + a.h / 2, b.y + b.h / 2);
+    float inter = std::max(0.0f, x2 - x1) * std::max(0.0f, y2 - y1);
+    float total = a.w * a.h + b.w * b.h - inter;
+    return total > 0.0f ? inter / total : 0.0f;
+}
+
+// greedy per class, highest score first
+template <typename T, typename Box>
+static void suppress(std::vector<T>& items, Box box, float threshold) {
+    std::stable_sort(items.begin(), items.end(), [&](const T& a, const T& b) { return box(a).score > box(b).score; });
+    std::vector<T> kept;
+    kept.reserve(items.size());
+    for (auto& item : items) {
+        bool keep = true;
+        for (auto& other : kept) {
+            if (box(other).target == box(item).target && iou(box(other), box(item)) > threshold) {
+                keep = false;
+                break;
+            }
+        }
+        if (keep) {
+            kept.push_back(std::move(item));
+        }
+    }
+    items.swap(kept);
+}
+
+// cols x rows tiles of equal size spread over the region, neighbours share at least `overlap` of a tile
+static void tileRects(const cv2::Rect& region, const ModelNode::Tiling& tiling, std::vector<cv2::Rect>& rects) {
+    int cols      = std::max(tiling.cols, 1);
+    int rows      = std::max(tiling.rows, 1);
+    float overlap = std::min(std::max(tiling.overlap, 0.0f), 0.9f);
+    int tw        = std::min(region.width, static_cast<int>(std::ceil(region.width / (cols - (cols - 1) * overlap))));
+    int th        = std::min(region.height, static_cast<int>(std::ceil(region.height / (rows - (rows - 1) * overlap))));
+
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < cols; c++) {
+            int x = cols > 1 ? static_cast<int>(std::lround(c * (region.width - tw) / (cols - 1.0))) : (region.width - tw) / 2;
+            int y = rows > 1 ? static_cast<int>(std::lround(r * (region.height - th) / (rows - 1.0))) : (region.height - th) / 2;
+            rects.emplace_back(region.x + x, region.y + y, tw, th);
+        }
+    }
+}
+
 ModelNode::ModelNode(std::string id)
-    : Node("model", id), uri_(""), debug_(true), trace_(false), counting_(false), count_(0), engine_(nullptr), model_(nullptr), thread_(nullptr), camera_(nullptr), frame_(30) {}
+    : Node("model", id),
+      uri_(""),
+      pending_{true,
+               false,
+               {90, 0, 0, true, 0},
+               NodeServer::Format::JSON,
+               false,
+               false,
+               Coords::MODEL,
+               {1, 1, 0.2f, true, 0.5f},
+               {false, 12, 0.01f, 0, true},
+               {false, 0.02f, 10, 0},
+               {0.0f, 0},
+               {},
+               json::array(),
+               {},
+               -1.0f,
+               -1.0f,
+               -1,
+               0,
+               0,
+               0,
+               0,
+               0,
+               0,
+               0,
+               0},
+      options_(std::make_shared<const Options>(pending_)),
+      count_(0),
+      engine_(nullptr),
+      model_(nullptr),
+      camera_(nullptr),
+      free_(MODEL_PIPELINE_DEPTH),
+      ready_(MODEL_PIPELINE_DEPTH),
+      done_(MODEL_PIPELINE_DEPTH),
+      ready_depth_(0),
+      done_depth_(0) {}
 
 ModelNode::~ModelNode() {
     onDestroy();
 }
 
 
-void ModelNode::threadEntry() {
+void ModelNode::preprocessEntry() {
+    int32_t width     = static_cast<const ma_img_t*>(model_->getInput())->width;
+    int32_t height    = static_cast<const ma_img_t*>(model_->getInput())->height;
+    videoFrame* frame     = nullptr;
+    ModelJob* job         = nullptr;
+    ma_tick_t start       = 0;
+    uint32_t motion_epoch = 0;
+    uint32_t rate_epoch   = 0;
+
+    while (started_) {
+        // take a free slot first so the frame we fetch afterwards is as fresh as possible
+        if (job == nullptr && !free_.fetch(reinterpret_cast<void**>(&job), Tick::fromSeconds(2))) {
+            continue;
+        }
+
+        // the motion gate and the rate settings are only ever touched here, the rate before waiting on a frame
+        // as it decides which captures are handed over at all
+        const std::shared_ptr<const Options> options = this->options();
+        if (options->rate_epoch != rate_epoch) {
+            rate_epoch = options->rate_epoch;
+            rate_.configure(options->rate.fps, options->rate.latency);
+        }
+        if (options->motion_epoch != motion_epoch) {
+            motion_epoch         = options->motion_epoch;
+            const Motion& motion = options->motion;
+            motion_.configure(motion.enabled, motion.threshold, motion.area, motion.interval);
+        }
 
-    ma_err_t err           = MA_OK;
-    Detector* detector     = nullptr;
-    Classifier* classifier = nullptr;
-    int32_t width          = static_cast<const ma_img_t*>(model_->getInput())->width;
-    int32_t height         = static_cast<const ma_img_t*>(model_->getInput())->height;
-    int32_t take           = 0;
-    cv2::Mat* frame        = nullptr;
-    ma_tick_t preprocess   = 0;
+        if (!frame_.fetch(&frame, Tick::fromSeconds(2))) {
+            continue;
+        }
+        job->dequeued = Tick::current();
 
-    switch (model_->getType()) {
-        case MA_MODEL_TYPE_IMCLS:
-            classifier = static_cast<Classifier*>(model_);
-            break;
-        default:
-            detector = static_cast<Detector*>(model_);
-            break;
+        // a static scene skips inference, the last result is repeated or nothing is published at all
+        start        = Tick::current();
+        bool changed = motion_.check(frame->img.data, frame->img.width, frame->img.height, frame->img.width * 3);
+        if (!changed && !options->motion.repeat) {
+            frame->release();
+            frame = nullptr;
+            continue;
+        }
+
+        // regions of interest and / or tiles, each one letterboxed on its own,
+        // the whole frame is only needed when it runs too or for the debug image
+        const Tiling& tiling = options->tiling;
+        const bool tiled     = tiling.cols * tiling.rows > 1;
+        std::vector<cv2::Rect> rects;
+        job->rois.clear();
+        for (auto& roi : options->rois) {
+            int x = std::lround(roi[0] * frame->img.width / 100.0f);
+            int y = std::lround(roi[1] * frame->img.height / 100.0f);
+            int w = std::min(static_cast<int>(std::lround(roi[2] * frame->img.width / 100.0f)), frame->img.width - x);
+            int h = std::min(static_cast<int>(std::lround(roi[3] * frame->img.height / 100.0f)), frame->img.height - y);
+            if (w > 0 && h > 0) {
+                job->rois.emplace_back(x, y, w, h);
+            }
+        }
+        for (auto& roi : job->rois) {
+            if (!tiled || tiling.global) {
+                rects.push_back(roi);
+            }
+            if (tiled) {
+                tileRects(roi, tiling, rects);
+            }
+        }
+        if (job->rois.empty() && tiled) {
+            tileRects(cv2::Rect(0, 0, frame->img.width, frame->img.height), tiling, rects);
+        }
+        job->global = rects.empty() || (job->rois.empty() && tiling.global);
+
+        // resize & letterbox & BGR2RGB in one pass, the frame is shared with other consumers so only read from it
+        letterbox_.configure(frame->img.width, frame->img.height, width, height);
+        if ((changed && job->global) || options->debug) {
+            if (job->encoding.load()) {
+                job->image = cv2::Mat(height, width, CV_8UC3);  // the previous input is still being encoded
+                job->encoding.store(false);
+            }
+            letterbox_.run(frame->img.data, frame->img.width * 3, job->image.data);
+        }
+        job->skipped       = !changed;
+        job->sequence      = frame->sequence;
+        job->timestamp     = frame->timestamp;
+        job->frame_width   = frame->img.width;
+        job->frame_height  = frame->img.height;
+        job->left          = letterbox_.left();
+        job->top           = letterbox_.top();
+        job->scaled_width  = letterbox_.width();
+        job->scaled_height = letterbox_.height();
+        job->preprocess    = Tick::current() - start;
+
+        job->crops.resize(rects.size());
+        crop_letterboxes_.resize(rects.size());
+        for (size_t i = 0; i < rects.size(); i++) {
+            ModelCrop& crop      = job->crops[i];
+            Letterbox& letterbox = crop_letterboxes_[i];
+            ma_tick_t crop_start = Tick::current();
+
+            crop.rect = rects[i];
+            letterbox.configure(crop.rect.width, crop.rect.height, width, height);
+            if (changed) {
+                if (crop.image.empty()) {
+                    crop.image = cv2::Mat(height, width, CV_8UC3);
+                }
+                letterbox.run(frame->img.data + (crop.rect.y * frame->img.width + crop.rect.x) * 3, frame->img.width * 3, crop.image.data);
+            }
+            crop.left          = letterbox.left();
+            crop.top           = letterbox.top();
+            crop.scaled_width  = letterbox.width();
+            crop.scaled_height = letterbox.height();
+            crop.preprocess    = Tick::current() - crop_start;
+        }
+        frame->release();  // pixels consumed, hand the slot back to the camera
+        frame = nullptr;
+
+        job->count    = ++count_;
+        job->prepared = Tick::current();
+
+        ready_depth_++;
+        ready_.post(job);
+        job = nullptr;
+    }
+
+    if (job != nullptr) {
+        free_.post(job);
     }
+}
+
+ma_err_t ModelNode::invoke(cv2::Mat& image, ModelJob* job, const ModelCrop* crop) {
+    int32_t width  = static_cast<const ma_img_t*>(model_->getInput())->width;
+    int32_t height = static_cast<const ma_img_t*>(model_->getInput())->height;
+    ma_err_t err   = MA_OK;
+
+    ma_tensor_t tensor = {.is_physical = false, .is_variable = false};
+    tensor.size        = height * width * 3;
+    tensor.data.data   = reinterpret_cast<void*>(image.data);
+    engine_->setInput(0, tensor);
+
+    // 0..1 of the crop input -> camera pixels -> 0..1 of the whole frame input, x' = x * ax + bx
+    float ax = 1.0f;
+    float ay = 1.0f;
+    float bx = 0.0f;
+    float by = 0.0f;
+    if (crop != nullptr) {
+        float kx = static_cast<float>(job->scaled_width) / job->frame_width;
+        float ky = static_cast<float>(job->scaled_height) / job->frame_height;
+        float cx = static_cast<float>(crop->rect.width) / crop->scaled_width;
+        float cy = static_cast<float>(crop->rect.height) / crop->scaled_height;
+        ax       = cx * kx;
+        ay       = cy * ky;
+        bx       = ((crop->rect.x - crop->left * cx) * kx + job->left) / width;
+        by       = ((crop->rect.y - crop->top * cy) * ky + job->top) / height;
+    }
+    auto map = [&](ma_bbox_t box) {
+        box.x = box.x * ax + bx;
+        box.y = box.y * ay + by;
+        box.w = box.w * ax;
+        box.h = box.h * ay;
+        return box;
+    };
+
+    // results are copied out, the model reuses its own storage on the next run
+    if (model_->getOutputType() == MA_OUTPUT_TYPE_BBOX) {
+        Detector* detector = static_cast<Detector*>(model_);
+        err                = detector->run(nullptr);
+        for (auto& result : detector->getResults()) {
+            job->boxes.push_back(map(result));
+        }
+    } else if (model_->getOutputType() == MA_OUTPUT_TYPE_CLASS) {
+        Classifier* classifier = static_cast<Classifier*>(model_);
+        err                    = classifier->run(nullptr);
+        auto _results          = classifier->getResults();
+        job->classes.insert(job->classes.end(), _results.begin(), _results.end());
+    } else if (model_->getOutputType() == MA_OUTPUT_TYPE_KEYPOINT) {
+        PoseDetector* pose_detector = static_cast<PoseDetector*>(model_);
+        err                         = pose_detector->run(nullptr);
+        for (auto& result : pose_detector->getResults()) {
+            job->keypoints.push_back(result);
+            auto& keypoint = job->keypoints.back();
+            keypoint.box   = map(keypoint.box);
+            for (auto& pt : keypoint.pts) {
+                pt.x = pt.x * ax + bx;
+                pt.y = pt.y * ay + by;
+            }
+        }
+    } else if (model_->getOutputType() == MA_OUTPUT_TYPE_SEGMENT) {
+        Segmentor* segmentor = static_cast<Segmentor*>(model_);
+        err                  = segmentor->run(nullptr);
+        for (auto& result : segmentor->getResults()) {
+            job->segments.push_back(result);
+            job->segments.back().box = map(result.box);  // the mask stays in crop space
+        }
+    }
+
+    return err;
+}
+
+void ModelNode::merge(ModelJob* job, float threshold) {
+    suppress(job->boxes, [](const ma_bbox_t& box) -> const ma_bbox_t& { return box; }, threshold);
+    suppress(job->keypoints, [](const ma_keypoint3f_t& keypoint) -> const ma_bbox_t& { return keypoint.box; }, threshold);
+    suppress(job->segments, [](const ma_segm2f_t& segment) -> const ma_bbox_t& { return segment.box; }, threshold);
+
+    // a class once, with its best score
+    std::stable_sort(job->classes.begin(), job->classes.end(), [](const ma_class_t& a, const ma_class_t& b) { return a.score > b.score; });
+    std::vector<ma_class_t> classes;
+    for (auto& result : job->classes) {
+        if (std::none_of(classes.begin(), classes.end(), [&](const ma_class_t& other) { return other.target == result.target; })) {
+            classes.push_back(result);
+        }
+    }
+    job->classes.swap(classes);
+}
+
+void ModelNode::inferenceEntry() {
+    ModelJob* job   = nullptr;
+    ma_tick_t start = 0;
+    ModelJob held;  // results of the last inference, repeated while the scene is static
+    uint32_t model_epoch = 0;
 
     while (started_) {
-        if (!frame_.fetch(reinterpret_cast<void**>(&frame), Tick::fromSeconds(2))) {
+        if (!ready_.fetch(reinterpret_cast<void**>(&job), Tick::fromSeconds(2))) {
             continue;
         }
+        ready_depth_--;
 
-        cv2::Mat image = frame->clone();
-
-        Thread::enterCritical();
-        json reply = json::object({{"type", MA_MSG_TYPE_EVT}, {"name", "invoke"}, {"code", MA_OK}, {"data", {{"count", ++count_}}}});
-
-        // resize & letterbox
-        preprocess          = Tick::current();
-        int ih              = image.rows;
-        int iw              = image.cols;
-        int oh              = height;
-        int ow              = width;
-        double resize_scale = std::min((double)oh / ih, (double)ow / iw);
-        int nh              = (int)(ih * resize_scale);
-        int nw              = (int)(iw * resize_scale);
-        cv2::resize(image, image, cv2::Size(nw, nh));
-        int top    = (oh - nh) / 2;
-        int bottom = (oh - nh) - top;
-        int left   = (ow - nw) / 2;
-        int right  = (ow - nw) - left;
-        cv2::copyMakeBorder(image, image, top, bottom, left, right, cv2::BORDER_CONSTANT, cv2::Scalar::all(114));
-        cv2::cvtColor(image, image, cv2::COLOR_BGR2RGB);
-        preprocess = Tick::current() - preprocess;
-
-        reply["data"]["resolution"] = json::array({width, height});
-
-        ma_tensor_t tensor = {.is_physical = false, .is_variable = false};
-        tensor.size        = height * width * 3;
-        tensor.data.data   = reinterpret_cast<void*>(image.data);
-        engine_->setInput(0, tensor);
-
-        reply["data"]["labels"] = json::array();
-
-        if (model_->getOutputType() == MA_OUTPUT_TYPE_BBOX) {
-            Detector* detector     = static_cast<Detector*>(model_);
-            err                    = detector->run(nullptr);
-            auto _results          = detector->getResults();
-            reply["data"]["boxes"] = json::array();
-            std::vector<ma_bbox_t> _bboxes;
-            _bboxes.assign(_results.begin(), _results.end());
-            if (trace_) {
-                auto tracks             = tracker_.inplace_update(_bboxes);
-                reply["data"]["tracks"] = tracks;
-                for (int i = 0; i < _bboxes.size(); i++) {
-                    reply["data"]["boxes"].push_back({static_cast<int16_t>(_bboxes[i].x * width),
-                                                      static_cast<int16_t>(_bboxes[i].y * height),
-                                                      static_cast<int16_t>(_bboxes[i].w * width),
-                                                      static_cast<int16_t>(_bboxes[i].h * height),
-                                                      static_cast<int8_t>(_bboxes[i].score * 100),
-                                                      _bboxes[i].target});
-                    if (labels_.size() > _bboxes[i].target) {
-                        reply["data"]["labels"].push_back(labels_[_bboxes[i].target]);
-                    } else {
-                        reply["data"]["labels"].push_back(std::string("N/A-" + std::to_string(_bboxes[i].target)));
-                    }
-                    if (counting_) {
-                        counter_.update(tracks[i], _bboxes[i].x * 100, _bboxes[i].y * 100);
-                    }
-                }
-                if (counting_ && _bboxes.size() == 0) {
-                    counter_.update(-1, 0, 0);
-                }
+        start        = Tick::current();
+        job->started = start;
+
+        // thresholds change between two runs, never during one
+        const std::shared_ptr<const Options> options = this->options();
+        if (options->model_epoch != model_epoch) {
+            model_epoch = options->model_epoch;
+            if (options->threshold >= 0.0f) {
+                model_->setConfig(MA_MODEL_CFG_OPT_THRESHOLD, options->threshold);
+            }
+            if (options->nms >= 0.0f) {
+                model_->setConfig(MA_MODEL_CFG_OPT_NMS, options->nms);
+            }
+            if (options->topk >= 0) {
+                model_->setConfig(MA_MODEL_CFG_OPT_TOPK, options->topk);
+            }
+        }
+
+        if (job->skipped) {
+            job->err       = MA_OK;
+            job->boxes     = held.boxes;
+            job->classes   = held.classes;
+            job->keypoints = held.keypoints;
+            job->segments  = held.segments;
+            job->perf      = {0, 0, 0};
+            for (auto& crop : job->crops) {
+                crop.perf = {0, 0, 0};
+            }
+            job->inferred  = Tick::current();
+            job->inference = job->inferred - start;
+            done_depth_++;
+            done_.post(job);
+            continue;
+        }
+
+        job->err = MA_OK;
+        job->boxes.clear();
+        job->classes.clear();
+        job->keypoints.clear();
+        job->segments.clear();
+
+        // back to back, the model owns a single set of buffers
+        if (job->global) {
+            job->err  = invoke(job->image, job, nullptr);
+            job->perf = model_->getPerf();
+        }
+        for (auto& crop : job->crops) {
+            ma_err_t err = invoke(crop.image, job, &crop);
+            crop.perf    = model_->getPerf();
+            if (err != MA_OK) {
+                job->err = err;
+            }
+        }
+        if (job->crops.size() + (job->global ? 1 : 0) > 1) {
+            merge(job, options->tiling.iou);
+        }
+
+        job->inferred  = Tick::current();
+        job->inference = job->inferred - start;
+
+        if (options->motion.enabled) {
+            held.boxes     = job->boxes;
+            held.classes   = job->classes;
+            held.keypoints = job->keypoints;
+            held.segments  = job->segments;
+        }
+
+        done_depth_++;
+        done_.post(job);
+    }
+}
+
+// one job through the publish stage: tracker, counters, publish-on-change and the result written into
+// state.payload in the node's format; false when publish-on-change leaves nothing to send
+bool ModelNode::build(ModelJob* job, const Options& options, PublishState& state) {
+    state.start = Tick::current();
+
+    // the tracker, the counter, the zones and the emitter are only ever touched here, resets requested by the
+    // control plane included
+    if (options.tracker_epoch != state.tracker_epoch) {
+        state.tracker_epoch = options.tracker_epoch;
+        tracker_.clear();
+        zones_.clear();
+        emitter_.reset();
+    }
+    if (options.counter_epoch != state.counter_epoch) {
+        state.counter_epoch = options.counter_epoch;
+        counter_.clear();
+        state.splitter = counter_.getSplitter();
+    }
+    if (options.splitter_epoch != state.splitter_epoch) {
+        state.splitter_epoch = options.splitter_epoch;
+        counter_.setSplitter(options.splitter);
+        state.splitter = counter_.getSplitter();
+    }
+    if (options.zones_epoch != state.zones_epoch) {
+        state.zones_epoch = options.zones_epoch;
+        zones_.configure(options.zones);
+    }
+    if (options.emit_epoch != state.emit_epoch) {
+        state.emit_epoch = options.emit_epoch;
+        const Emit& emit = options.emit;
+        emitter_.configure(emit.enabled, emit.tolerance, emit.score, emit.keyframe);
+    }
+    const Coords coords = options.coords;
+    const bool emitting = options.emit.enabled;
+
+    const int32_t width         = state.width;
+    const int32_t height        = state.height;
+    const ma_output_type_t type = state.type;
+
+    // results are 0..1 of the model input, frame coordinates undo the letterbox: (x * width - left) * frame_width / scaled_width
+    float sx = width;
+    float sy = height;
+    float ox = 0.0f;
+    float oy = 0.0f;
+    if (coords != Coords::MODEL) {
+        float fx = coords == Coords::FRAME ? static_cast<float>(job->frame_width) / job->scaled_width : 1.0f / job->scaled_width;
+        float fy = coords == Coords::FRAME ? static_cast<float>(job->frame_height) / job->scaled_height : 1.0f / job->scaled_height;
+        sx       = width * fx;
+        sy       = height * fy;
+        ox       = job->left * fx;
+        oy       = job->top * fy;
+    }
+
+    // tracks and counts first, with publish-on-change they decide whether anything goes out at all
+    bool tracking = options.trace && type == MA_OUTPUT_TYPE_BBOX;
+    bool counting = options.counting && type == MA_OUTPUT_TYPE_BBOX;
+    state.tracks.clear();
+    if (tracking) {
+        std::vector<ma_bbox_t>& _bboxes = job->boxes;
+        tracker_.inplace_update(_bboxes, state.tracks);
+        state.xs.resize(_bboxes.size());
+        state.ys.resize(_bboxes.size());
+        for (size_t i = 0; i < _bboxes.size(); i++) {
+            // the splitter and the zones are in percent of the published space
+            state.xs[i] = (coords == Coords::MODEL ? _bboxes[i].x : (_bboxes[i].x * width - job->left) / job->scaled_width) * 100;
+            state.ys[i] = (coords == Coords::MODEL ? _bboxes[i].y : (_bboxes[i].y * height - job->top) / job->scaled_height) * 100;
+            if (counting) {
+                counter_.update(state.tracks[i], state.xs[i], state.ys[i]);
+            }
+        }
+        if (counting && _bboxes.size() == 0) {
+            counter_.update(-1, 0, 0);
+        }
+        zones_.update(state.tracks, state.xs, state.ys, job->timestamp);
+    }
+    bool zones = tracking && zones_.changed();
+    if (counting) {
+        state.counts = counter_.get();
+    }
+
+    size_t results          = 0;
+    const char* results_key = nullptr;
+    switch (type) {
+        case MA_OUTPUT_TYPE_BBOX:
+            results     = job->boxes.size();
+            results_key = "boxes";
+            break;
+        case MA_OUTPUT_TYPE_CLASS:
+            results     = job->classes.size();
+            results_key = "classes";
+            break;
+        case MA_OUTPUT_TYPE_KEYPOINT:
+            results     = job->keypoints.size();
+            results_key = "keypoints";
+            break;
+        case MA_OUTPUT_TYPE_SEGMENT:
+            results     = job->segments.size();
+            results_key = "segments";
+            break;
+        default:
+            break;
+    }
+    auto boxOf = [&](size_t i) -> const ma_bbox_t& {
+        switch (type) {
+            case MA_OUTPUT_TYPE_KEYPOINT:
+                return job->keypoints[i].box;
+            case MA_OUTPUT_TYPE_SEGMENT:
+                return job->segments[i].box;
+            default:
+                return job->boxes[i];
+        }
+    };
+    auto targetOf = [&](size_t i) -> int32_t {
+        return type == MA_OUTPUT_TYPE_CLASS ? job->classes[i].target : boxOf(i).target;
+    };
+
+    // publish-on-change: a keyframe carries the full state and the key of every object, in between only
+    // what appeared, vanished or changed beyond the tolerance goes out, and nothing when nothing did
+    bool keyframe = true;
+    if (emitting) {
+        state.items.clear();
+        for (size_t i = 0; i < results; i++) {
+            if (type == MA_OUTPUT_TYPE_CLASS) {
+                state.items.push_back({-1, 0, job->classes[i].target, 0.0f, 0.0f, 0.0f, 0.0f, job->classes[i].score});
             } else {
-                for (int i = 0; i < _bboxes.size(); i++) {
-                    reply["data"]["boxes"].push_back({static_cast<int16_t>(_bboxes[i].x * width),
-                                                      static_cast<int16_t>(_bboxes[i].y * height),
-                                                      static_cast<int16_t>(_bboxes[i].w * width),
-                                                      static_cast<int16_t>(_bboxes[i].h * height),
-                                                      static_cast<int8_t>(_bboxes[i].score * 100),
-                                                      _bboxes[i].target});
-                    if (labels_.size() > _bboxes[i].target) {
-                        reply["data"]["labels"].push_back(labels_[_bboxes[i].target]);
-                    } else {
-                        reply["data"]["labels"].push_back(std::string("N/A-" + std::to_string(_bboxes[i].target)));
-                    }
-                }
+                const ma_bbox_t& box = boxOf(i);
+                state.items.push_back({tracking ? state.tracks[i] : -1, 0, box.target, box.x, box.y, box.w, box.h, box.score});
             }
-            if (counting_) {
-                reply["data"]["counts"] = counter_.get();
-                reply["data"]["lines"]  = json::array();
-                reply["data"]["lines"].push_back(counter_.getSplitter());
-            }
-        } else if (model_->getOutputType() == MA_OUTPUT_TYPE_CLASS) {
-            Classifier* classifier   = static_cast<Classifier*>(model_);
-            err                      = classifier->run(nullptr);
-            auto _results            = classifier->getResults();
-            reply["data"]["classes"] = json::array();
-            for (auto& result : _results) {
-                reply["data"]["classes"].push_back({static_cast<int8_t>(result.score * 100), result.target});
-                if (labels_.size() > result.target) {
-                    reply["data"]["labels"].push_back(result.target);
-                } else {
-                    reply["data"]["labels"].push_back(std::string("N/A-" + std::to_string(result.target)));
+        }
+        bool changed = emitter_.apply(state.items, job->timestamp, keyframe, state.added, state.updated, state.removed);
+        // zones are only written when they changed
+        if (!keyframe && !changed && !zones && (!counting || state.counts == state.last_counts)) {
+            state.suppressed++;
+            // still a frame through the pipeline, the latency budget keeps its samples in a steady scene
+            rate_.feedback(Tick::current() - job->timestamp);
+            return false;
+        }
+    }
+    if (counting) {
+        state.last_counts.swap(state.counts);
+    }
+
+    state.payload.clear();
+    JsonWriter writer(state.payload, options.format);
+
+    auto coord = [&](float value) {
+        if (coords == Coords::NORMALIZED) {
+            writer.value(std::round(value * 10000.0f) / 10000.0f);
+        } else {
+            writer.value(static_cast<int32_t>(static_cast<int16_t>(value)));
+        }
+    };
+    auto writeBox = [&](const ma_bbox_t& box) {
+        writer.beginArray();
+        coord(box.x * sx - ox);
+        coord(box.y * sy - oy);
+        coord(box.w * sx);
+        coord(box.h * sy);
+        writer.value(static_cast<int32_t>(static_cast<int8_t>(box.score * 100))).value(static_cast<int32_t>(box.target)).endArray();
+    };
+    auto writeLabel = [&](int32_t target) {
+        if (target >= 0 && labels_.size() > target) {
+            writer.value(labels_[target]);
+        } else {
+            char label[24];
+            snprintf(label, sizeof(label), "N/A-%d", target);
+            writer.value(label);
+        }
+    };
+    auto writeResult = [&](size_t i) {
+        switch (type) {
+            case MA_OUTPUT_TYPE_BBOX:
+                writeBox(job->boxes[i]);
+                break;
+            case MA_OUTPUT_TYPE_CLASS:
+                writer.beginArray().value(static_cast<int32_t>(static_cast<int8_t>(job->classes[i].score * 100))).value(static_cast<int32_t>(job->classes[i].target)).endArray();
+                break;
+            case MA_OUTPUT_TYPE_KEYPOINT:
+                writer.beginArray();
+                writeBox(job->keypoints[i].box);
+                writer.beginArray();
+                for (auto& pt : job->keypoints[i].pts) {
+                    writer.beginArray();
+                    coord(pt.x * sx - ox);
+                    coord(pt.y * sy - oy);
+                    writer.value(static_cast<int32_t>(static_cast<int8_t>(pt.z * 100))).endArray();
                 }
+                writer.endArray().endArray();
+                break;
+            case MA_OUTPUT_TYPE_SEGMENT:
+                writer.beginArray();
+                writeBox(job->segments[i].box);
+                writer.beginArray().value(static_cast<int32_t>(job->segments[i].mask.width)).value(static_cast<int32_t>(job->segments[i].mask.height)).endArray();
+                writer.endArray();
+                break;
+            default:
+                writer.null();
+                break;
+        }
+    };
+    auto writeItem = [&](size_t i) {
+        writer.beginObject().key("key").value(state.items[i].key).key("label");
+        writeLabel(targetOf(i));
+        writer.key("value");
+        writeResult(i);
+        writer.endObject();
+    };
+
+    writer.beginObject().key("type").value(static_cast<int32_t>(MA_MSG_TYPE_EVT)).key("name").value("invoke").key("code").value(static_cast<int32_t>(MA_OK));
+    writer.key("data").beginObject().key("count").value(job->count);
+
+    writer.key("resolution").beginArray();
+    switch (coords) {
+        case Coords::MODEL:
+            writer.value(width).value(height);
+            break;
+        case Coords::FRAME:
+            writer.value(job->frame_width).value(job->frame_height);
+            break;
+        case Coords::NORMALIZED:
+            writer.value(1).value(1);
+            break;
+    }
+    writer.endArray();
+
+    if (!job->rois.empty()) {
+        // [x, y, w, h] like the boxes, centre based
+        float kx = static_cast<float>(job->scaled_width) / job->frame_width / width;
+        float ky = static_cast<float>(job->scaled_height) / job->frame_height / height;
+        writer.key("rois").beginArray();
+        for (auto& roi : job->rois) {
+            float x = (roi.x + roi.width / 2.0f) * kx + static_cast<float>(job->left) / width;
+            float y = (roi.y + roi.height / 2.0f) * ky + static_cast<float>(job->top) / height;
+            writer.beginArray();
+            coord(x * sx - ox);
+            coord(y * sy - oy);
+            coord(roi.width * kx * sx);
+            coord(roi.height * ky * sy);
+            writer.endArray();
+        }
+        writer.endArray();
+    }
+
+    if (keyframe) {
+        writer.key("labels").beginArray();
+        for (size_t i = 0; i < results; i++) {
+            writeLabel(targetOf(i));
+        }
+        writer.endArray();
+        if (results_key != nullptr) {
+            writer.key(results_key).beginArray();
+            for (size_t i = 0; i < results; i++) {
+                writeResult(i);
             }
-        } else if (model_->getOutputType() == MA_OUTPUT_TYPE_KEYPOINT) {
-            PoseDetector* pose_detector = static_cast<PoseDetector*>(model_);
-            err                         = pose_detector->run(nullptr);
-            auto _results               = pose_detector->getResults();
-            reply["data"]["keypoints"]  = json::array();
-            for (auto& result : _results) {
-                json pts = json::array();
-                for (auto& pt : result.pts) {
-                    pts.push_back({static_cast<int16_t>(pt.x * width), static_cast<int16_t>(pt.y * height), static_cast<int8_t>(pt.z * 100)});
-                }
-                json box = {static_cast<int16_t>(result.box.x * width),
-                            static_cast<int16_t>(result.box.y * height),
-                            static_cast<int16_t>(result.box.w * width),
-                            static_cast<int16_t>(result.box.h * height),
-                            static_cast<int8_t>(result.box.score * 100),
-                            result.box.target};
-                if (labels_.size() > result.box.target) {
-                    reply["data"]["labels"].push_back(labels_[result.box.target]);
-                } else {
-                    reply["data"]["labels"].push_back(std::string("N/A-" + std::to_string(result.box.target)));
-                }
-                reply["data"]["keypoints"].push_back({box, pts});
-            }
-        } else if (model_->getOutputType() == MA_OUTPUT_TYPE_SEGMENT) {
-            Segmentor* segmentor      = static_cast<Segmentor*>(model_);
-            err                       = segmentor->run(nullptr);
-            auto _results             = segmentor->getResults();
-            reply["data"]["segments"] = json::array();
-            for (auto& result : _results) {
-                json box = {static_cast<int16_t>(result.box.x * width),
-                            static_cast<int16_t>(result.box.y * height),
-                            static_cast<int16_t>(result.box.w * width),
-                            static_cast<int16_t>(result.box.h * height),
-                            static_cast<int8_t>(result.box.score * 100),
-                            result.box.target};
-                if (labels_.size() > result.box.target) {
-                    reply["data"]["labels"].push_back(labels_[result.box.target]);
-                } else {
-                    reply["data"]["labels"].push_back(std::string("N/A-" + std::to_string(result.box.target)));
-                }
-                json mask = {static_cast<int16_t>(result.mask.width), static_cast<int16_t>(result.mask.height)};
-                reply["data"]["segments"].push_back({box, mask});
+            writer.endArray();
+        }
+        if (tracking) {
+            writer.key("tracks").beginArray();
+            for (auto track : state.tracks) {
+                writer.value(track);
             }
+            writer.endArray();
+        }
+        if (emitting) {
+            writer.key("keys").beginArray();
+            for (auto& item : state.items) {
+                writer.value(item.key);
+            }
+            writer.endArray();
+        }
+    } else {
+        writer.key("delta").beginObject();
+        writer.key("added").beginArray();
+        for (auto i : state.added) {
+            writeItem(i);
         }
+        writer.endArray();
+        writer.key("updated").beginArray();
+        for (auto i : state.updated) {
+            writeItem(i);
+        }
+        writer.endArray();
+        writer.key("removed").beginArray();
+        for (auto key : state.removed) {
+            writer.value(key);
+        }
+        writer.endArray();
+        writer.endObject();
+    }
+    if (emitting) {
+        writer.key("keyframe").value(keyframe);
+    }
+
+    // only the zones whose counts moved, all of them once after (re)configuring and on a keyframe
+    bool all_zones = keyframe && emitting;
+    if (tracking && (zones || (all_zones && !zones_.empty()))) {
+        writer.key("zones");
+        zones_.write(writer, all_zones, job->timestamp);
+    }
+
+    if (counting) {
+        writer.key("counts").beginArray();
+        for (auto count : state.last_counts) {
+            writer.value(static_cast<int32_t>(count));
+        }
+        writer.endArray();
+        writer.key("lines").beginArray().beginArray();
+        for (auto point : state.splitter) {
+            writer.value(static_cast<int32_t>(point));
+        }
+        writer.endArray().endArray();
+    }
+
+    // the whole frame first when it ran, then one entry per crop in order
+    writer.key("perf").beginArray();
+    if (job->global) {
+        const auto& _perf = job->perf;
+        writer.beginArray();
+        writer.value(static_cast<int64_t>(_perf.preprocess + Tick::toMilliseconds(job->preprocess)));
+        writer.value(static_cast<int64_t>(_perf.inference)).value(static_cast<int64_t>(_perf.postprocess));
+        writer.endArray();
+    }
+    for (auto& crop : job->crops) {
+        writer.beginArray();
+        writer.value(static_cast<int64_t>(crop.perf.preprocess + Tick::toMilliseconds(crop.preprocess)));
+        writer.value(static_cast<int64_t>(crop.perf.inference)).value(static_cast<int64_t>(crop.perf.postprocess));
+        writer.endArray();
+    }
+    writer.endArray();
+
+    // stage wall times and queue depths, the slowest stage bounds the throughput
+    writer.key("pipeline").beginObject();
+    writer.key("stages").beginArray().value(Tick::toMilliseconds(job->preprocess)).value(Tick::toMilliseconds(job->inference)).value(Tick::toMilliseconds(state.last)).endArray();
+    writer.key("queues").beginArray().value(ready_depth_.load()).value(done_depth_.load()).endArray();
+
+    if (options.motion.enabled) {
+        uint32_t frames  = 0;
+        uint32_t skipped = 0;
+        motion_.stats(frames, skipped);
+        writer.key("motion").beginObject();
+        writer.key("repeated").value(job->skipped).key("frames").value(frames).key("skipped").value(skipped);
+        writer.key("ratio").value(frames > 0 ? static_cast<float>(skipped) / frames : 0.0f);
+        writer.endObject();
+    }
 
-        const auto _perf = model_->getPerf();
+    // frames replaced in the mailbox while we were busy, and frames the controller turned away
+    writer.key("dropped").beginArray().value(frame_.dropped()).value(rate_.dropped()).endArray();
+    writer.key("interval").value(rate_.interval());
+    if (emitting) {
+        writer.key("suppressed").value(state.suppressed);
+        state.suppressed = 0;
+    }
+    writer.endObject();
 
-        reply["data"]["perf"].push_back({_perf.preprocess + Tick::toMilliseconds(preprocess), _perf.inference, _perf.postprocess});
+    // capture to publish, drives the latency budget
+    ma_tick_t now = Tick::current();
+    ma_tick_t age = now - job->timestamp;
+    writer.key("age").value(Tick::toMilliseconds(age));
+    rate_.feedback(age);
 
+    // where the time between capture and publish went, ms per stage; the queue waits between stages
+    // are "ready" and "done", the server fills in "publish" (its own queue) and "send" (previous message)
+    uint32_t model_time = 0;
+    if (job->global) {
+        model_time += job->perf.preprocess + job->perf.inference;
+    }
+    for (auto& crop : job->crops) {
+        model_time += crop.perf.preprocess + crop.perf.inference;
+    }
+    uint32_t inference_stage = Tick::toMilliseconds(job->inferred - job->started);
+    writer.key("seq").value(job->sequence);
 
-        if (debug_) {
-            std::vector<uchar> buffer_;
-            std::vector<int> params_ = {cv2::IMWRITE_JPEG_QUALITY, 90};
-            cv2::cvtColor(image, image, cv2::COLOR_RGB2BGR);
-            cv2::imencode(".jpg", image, buffer_, params_);
-            // convert to base64
-            char* base64_data = new char[4 * ((buffer_.size() + 2) / 3) + 2];
-            int base64_len    = buffer_.size() * 4 / 3 + 10;
-            ma::utils::base64_encode(reinterpret_cast<unsigned char*>(buffer_.data()), buffer_.size(), base64_data, &base64_len);
-            reply["data"]["image"] = std::string(base64_data, base64_len);
-            delete[] base64_data;
+    // the debug image is filled into the empty string, the server patches the trace in place
+    writer.key("image").empty(state.image);
+    writer.key("trace").beginObject();
+    writer.key("dequeue").value(Tick::toMilliseconds(job->dequeued - job->timestamp));
+    writer.key("preprocess").value(Tick::toMilliseconds(job->prepared - job->dequeued));
+    writer.key("ready").value(Tick::toMilliseconds(job->started - job->prepared));
+    writer.key("inference").value(std::min(model_time, inference_stage));
+    writer.key("postprocess").value(inference_stage - std::min(model_time, inference_stage));
+    writer.key("done").value(Tick::toMilliseconds(state.start - job->inferred));
+    writer.key("serialize").value(Tick::toMilliseconds(Tick::current() - state.start));
+    writer.key("publish").fixed(0u, state.publish).key("send").fixed(0.0f, state.send);
+    writer.endObject().endObject().endObject();
+
+    return true;
+}
+
+void ModelNode::publishEntry() {
+    ModelJob* job = nullptr;
+    // kept between frames, a steady scene is written out without allocating
+    PublishState state{};
+    state.width    = static_cast<const ma_img_t*>(model_->getInput())->width;
+    state.height   = static_cast<const ma_img_t*>(model_->getInput())->height;
+    state.type     = model_->getOutputType();
+    state.splitter = counter_.getSplitter();
+
+    while (started_) {
+        if (!done_.fetch(reinterpret_cast<void**>(&job), Tick::fromSeconds(2))) {
+            continue;
+        }
+        done_depth_--;
+
+        const std::shared_ptr<const Options> options = this->options();
+        if (!build(job, *options, state)) {
+            free_.post(job);
+            state.last = Tick::current() - state.start;
+            continue;
+        }
+
+        std::string& payload            = state.payload;
+        const NodeServer::Format format = options->format;
+        const size_t image              = state.image;
+        const size_t publish            = state.publish;
+        const size_t send               = state.send;
+        if (options->debug) {
+            // the encoder shares job->image, the pre-process stage allocates a new one until the callback
+            // says the encoder let go of it; callbacks of this node run in order, the last one is the latest
+            job->encoding.store(true);
+            if (options->binary_image) {
+                const int32_t count         = job->count;
+                JpegEncoder::Options encode = options->encode;
+                encode.header               = NODE_PUBLISH_HEADER;
+                server_->response(id_, payload, format, publish, send);
+                JpegEncoder::instance()->submit(this, job->image, encode, [this, job, count](std::vector<uint8_t>& jpeg) {
+                    job->encoding.store(false);
+                    if (!jpeg.empty()) {
+                        // raw JPEG on the side topic, correlated by count
+                        server_->publish(id_, "image", count, std::move(jpeg));
+                    }
+                });
+            } else {
+                // the result waits for its image, this stage does not, the buffer goes along
+                JpegEncoder::instance()->submit(this, job->image, options->encode, [this, job, format, image, publish, send, text = std::move(payload)](std::vector<uint8_t>& jpeg) mutable {
+                    job->encoding.store(false);
+                    size_t grown = JsonWriter::fill(text, format, image, JpegEncoder::base64(jpeg));
+                    server_->response(id_, text, format, publish + grown, send + grown);
+                });
+                payload = std::string();
+            }
         } else {
-            reply["data"]["image"] = "";
+            server_->response(id_, payload, format, publish, send);
+        }
+
+        free_.post(job);
+
+        state.last = Tick::current() - state.start;
+    }
+}
+
+// "emit": "always" | "change" | {"mode": "always" | "change", "tolerance": 0..1 of the model input, "score": percent points, "keyframe": ms}
+ma_err_t ModelNode::setEmit(const json& emit) {
+    std::string mode = emit.is_string() ? emit.get<std::string>() : emit.is_object() ? emit.value("mode", std::string("change")) : std::string();
+    if (mode != "always" && mode != "change") {
+        return MA_EINVAL;
+    }
+    if (emit.is_object()) {
+        pending_.emit = {mode == "change", emit.value("tolerance", 0.02f), emit.value("score", 10), emit.value("keyframe", 10000)};
+    } else {
+        pending_.emit = {mode == "change", 0.02f, 10, 10000};
+    }
+    pending_.emit_epoch++;
+    return MA_OK;
+}
+
+std::shared_ptr<const ModelNode::Options> ModelNode::options() const {
+    return std::atomic_load(&options_);
+}
+
+// callers hold mutex_, the pipeline picks the new snapshot up with its next frame
+void ModelNode::commit() {
+    std::atomic_store(&options_, std::make_shared<const Options>(pending_));
+}
+
+ma_err_t ModelNode::setCoords(const std::string& coords) {
+    if (coords == "model") {
+        pending_.coords = Coords::MODEL;
+    } else if (coords == "frame") {
+        pending_.coords = Coords::FRAME;
+    } else if (coords == "normalized") {
+        pending_.coords = Coords::NORMALIZED;
+    } else {
+        return MA_EINVAL;
+    }
+    return MA_OK;
+}
+
+// "motion": true | false | {"threshold": luma levels, "area": 0..1, "interval": frames, "repeat": bool}
+void ModelNode::setMotion(const json& motion) {
+    if (motion.is_boolean()) {
+        pending_.motion = {motion.get<bool>(), 12, 0.01f, 0, pending_.motion.repeat};
+        pending_.motion_epoch++;
+    } else if (motion.is_object()) {
+        pending_.motion = {motion.value("enabled", true), motion.value("threshold", 12), motion.value("area", 0.01f), motion.value("interval", 0), motion.value("repeat", pending_.motion.repeat)};
+        pending_.motion_epoch++;
+    }
+}
+
+// "rate": {"fps": target frames per second, "latency": end-to-end budget in ms}, 0 or absent disables either
+void ModelNode::setRate(const json& rate) {
+    if (rate.is_object()) {
+        pending_.rate = {rate.value("fps", 0.0f), rate.value("latency", 0)};
+        pending_.rate_epoch++;
+    }
+}
+
+// "roi": [[x, y, w, h], ...] in percent of the frame, an empty list runs the whole frame again
+ma_err_t ModelNode::setRois(const json& rois) {
+    if (!rois.is_array()) {
+        return MA_EINVAL;
+    }
+    std::vector<std::array<float, 4>> values;
+    for (auto& roi : rois) {
+        if (!roi.is_array() || roi.size() != 4) {
+            return MA_EINVAL;
+        }
+        std::array<float, 4> value = roi.get<std::array<float, 4>>();
+        value[0]                   = std::min(std::max(value[0], 0.0f), 100.0f);
+        value[1]                   = std::min(std::max(value[1], 0.0f), 100.0f);
+        if (value[2] <= 0.0f || value[3] <= 0.0f) {
+            return MA_EINVAL;
         }
+        values.push_back(value);
+    }
+    pending_.rois.swap(values);
+    return MA_OK;
+}
 
-        server_->response(id_, reply);
+// see ZoneCounter::configure, checked here and applied by the publish stage
+ma_err_t ModelNode::setZones(const json& zones) {
+    if (ZoneCounter::validate(zones) != MA_OK) {
+        return MA_EINVAL;
+    }
+    pending_.zones = zones;
+    pending_.zones_epoch++;
+    return MA_OK;
+}
 
-        Thread::exitCritical();
+// "tiling": false | {"cols": 3, "rows": 2, "overlap": 0.2, "global": true, "iou": 0.5}
+void ModelNode::setTiling(const json& tiling) {
+    if (tiling.is_boolean()) {
+        pending_.tiling.cols = tiling.get<bool>() ? 2 : 1;
+        pending_.tiling.rows = tiling.get<bool>() ? 2 : 1;
+    } else if (tiling.is_object()) {
+        pending_.tiling.cols    = std::max(tiling.value("cols", pending_.tiling.cols), 1);
+        pending_.tiling.rows    = std::max(tiling.value("rows", pending_.tiling.rows), 1);
+        pending_.tiling.overlap = tiling.value("overlap", pending_.tiling.overlap);
+        pending_.tiling.global  = tiling.value("global", pending_.tiling.global);
+        pending_.tiling.iou     = tiling.value("iou", pending_.tiling.iou);
     }
-}  // namespace ma::node
+}
+
+void ModelNode::preprocessEntryStub(void* obj) {
+    reinterpret_cast<ModelNode*>(obj)->preprocessEntry();
+}
+
+void ModelNode::inferenceEntryStub(void* obj) {
+    reinterpret_cast<ModelNode*>(obj)->inferenceEntry();
+}
 
-void ModelNode::threadEntryStub(void* obj) {
-    reinterpret_cast<ModelNode*>(obj)->threadEntry();
+void ModelNode::publishEntryStub(void* obj) {
+    reinterpret_cast<ModelNode*>(obj)->publishEntry();
 }
 
 ma_err_t ModelNode::onCreate(const json& config) {
@@ -256,11 +1014,26 @@ ma_err_t ModelNode::onCreate(const json& config) {
     }
 
     MA_TRY {
-        engine_ = new EngineDefault();
+        // "engine": "hailo" | "cpu" | "mock", or {"type", "width", "height", "latency"}
+        std::string engine = "";
+        json options       = json::object();
+        if (config.contains("engine") && config["engine"].is_string()) {
+            engine = config["engine"].get<std::string>();
+        } else if (config.contains("engine") && config["engine"].is_object()) {
+            options = config["engine"];
+            engine  = options.value("type", engine);
+        }
+
+        engine_ = EngineFactory::create(engine, options.value("width", 0), options.value("height", 0));
 
         if (engine_ == nullptr) {
-            MA_THROW(Exception(MA_ENOMEM, "Engine create failed"));
+            MA_THROW(Exception(MA_ENOTSUP, "Engine not available: " + engine));
+        }
+#if CONFIG_MA_ENGINE_MOCK
+        if (engine == "mock" && options.contains("latency")) {
+            static_cast<EngineMock*>(engine_)->setLatency(options["latency"].get<uint32_t>());
         }
+#endif
         if (engine_->init() != MA_OK) {
             MA_THROW(Exception(MA_EINVAL, "Engine init failed"));
         }
@@ -281,25 +1054,72 @@ ma_err_t ModelNode::onCreate(const json& config) {
                 model_->setConfig(MA_MODEL_CFG_OPT_NMS, config["tiou"].get<float>());
             }
             if (config.contains("topk")) {
-                model_->setConfig(MA_MODEL_CFG_OPT_TOPK, config["tiou"].get<float>());
+                model_->setConfig(MA_MODEL_CFG_OPT_TOPK, config["topk"].get<int32_t>());
             }
             if (config.contains("debug")) {
-                debug_ = config["debug"].get<bool>();
+                pending_.debug = config["debug"].get<bool>();
+            }
+            if (config.contains("image") && config["image"].is_string()) {
+                pending_.binary_image = config["image"].get<std::string>() == "binary";
+            }
+            if (config.contains("encode") && config["encode"].is_object()) {
+                pending_.encode.quality = config["encode"].value("quality", pending_.encode.quality);
+                pending_.encode.width   = config["encode"].value("width", pending_.encode.width);
+                pending_.encode.height  = config["encode"].value("height", pending_.encode.height);
             }
             if (config.contains("trace")) {
-                trace_ = config["trace"].get<bool>();
+                pending_.trace = config["trace"].get<bool>();
             }
             if (config.contains("counting")) {
-                counting_ = config["counting"].get<bool>();
+                pending_.counting = config["counting"].get<bool>();
+            }
+            if (config.contains("motion")) {
+                setMotion(config["motion"]);
+            }
+            if (config.contains("tiling")) {
+                setTiling(config["tiling"]);
+            }
+            if (config.contains("rate")) {
+                setRate(config["rate"]);
+            }
+            if (config.contains("roi") && setRois(config["roi"]) != MA_OK) {
+                MA_THROW(Exception(MA_EINVAL, "invalid roi: " + config["roi"].dump()));
+            }
+            if (config.contains("emit") && setEmit(config["emit"]) != MA_OK) {
+                MA_THROW(Exception(MA_EINVAL, "unknown emit: " + config["emit"].dump()));
+            }
+            if (config.contains("coords") && config["coords"].is_string()) {
+                if (setCoords(config["coords"].get<std::string>()) != MA_OK) {
+                    MA_THROW(Exception(MA_EINVAL, "unknown coords: " + config["coords"].get<std::string>()));
+                }
             }
             if (config.contains("splitter") && config["splitter"].is_array()) {
-                counter_.setSplitter(config["splitter"].get<std::vector<int16_t>>());
+                pending_.splitter = config["splitter"].get<std::vector<int16_t>>();
+                pending_.splitter_epoch++;
+            }
+            if (config.contains("zones") && setZones(config["zones"]) != MA_OK) {
+                MA_THROW(Exception(MA_EINVAL, "invalid zones: " + config["zones"].dump()));
+            }
+            if (config.contains("queue") && config["queue"].is_number_integer()) {
+                if (server_->setPublishLimit(id_, config["queue"].get<int32_t>()) != MA_OK) {
+                    MA_THROW(Exception(MA_EINVAL, "invalid queue: " + std::to_string(config["queue"].get<int32_t>())));
+                }
+            }
+            if (config.contains("format") && config["format"].is_string()) {
+                if (server_->setFormat(id_, config["format"].get<std::string>()) != MA_OK) {
+                    MA_THROW(Exception(MA_EINVAL, "unknown format: " + config["format"].get<std::string>()));
+                }
+                pending_.format = server_->getFormat(id_);
             }
         }
 
-        thread_ = new Thread((type_ + "#" + id_).c_str(), &ModelNode::threadEntryStub, this);
-        if (thread_ == nullptr) {
-            MA_THROW(Exception(MA_ENOMEM, "Thread create failed"));
+        threads_.push_back(new Thread((type_ + "#" + id_ + "/pre").c_str(), &ModelNode::preprocessEntryStub, this));
+        threads_.push_back(new Thread((type_ + "#" + id_ + "/infer").c_str(), &ModelNode::inferenceEntryStub, this));
+        threads_.push_back(new Thread((type_ + "#" + id_ + "/post").c_str(), &ModelNode::publishEntryStub, this));
+        for (auto& thread : threads_) {
+            if (thread == nullptr) {
+                MA_THROW(Exception(MA_ENOMEM, "Thread create failed"));
+            }
         }
     }
     MA_CATCH(ma::Exception & e) {
@@ -311,10 +1131,10 @@ ma_err_t ModelNode::onCreate(const json& config) {
             delete model_;
             model_ = nullptr;
         }
-        if (thread_ != nullptr) {
-            delete thread_;
-            thread_ = nullptr;
+        for (auto& thread : threads_) {
+            delete thread;
         }
+        threads_.clear();
         MA_THROW(e);
     }
     MA_CATCH(std::exception & e) {
@@ -326,13 +1146,14 @@ ma_err_t ModelNode::onCreate(const json& config) {
             delete model_;
             model_ = nullptr;
         }
-        if (thread_ != nullptr) {
-            delete thread_;
-            thread_ = nullptr;
+        for (auto& thread : threads_) {
+            delete thread;
         }
+        threads_.clear();
         MA_THROW(Exception(MA_EINVAL, e.what()));
     }
 
+    commit();
     created_ = true;
 
     server_->response(id_, json::object({{"type", MA_MSG_TYPE_RESP}, {"name", "create"}, {"code", MA_OK}, {"data", info_}}));
@@ -343,31 +1164,81 @@ ma_err_t ModelNode::onCreate(const json& config) {
 ma_err_t ModelNode::onControl(const std::string& control, const json& data) {
     Guard guard(mutex_);
     ma_err_t err = MA_OK;
+    // every key is applied on its own, the reply carries the first one rejected
+    auto check = [&](ma_err_t result) {
+        if (result != MA_OK && err == MA_OK) {
+            err = result;
+        }
+    };
     if (control == "config") {
+        // the model is configured by the inference stage between two runs
         if (data.contains("tscore") && data["tscore"].is_number_float()) {
-            model_->setConfig(MA_MODEL_CFG_OPT_THRESHOLD, data["tscore"].get<float>());
+            pending_.threshold = data["tscore"].get<float>();
+            pending_.model_epoch++;
         }
         if (data.contains("tiou") && data["tiou"].is_number_float()) {
-            model_->setConfig(MA_MODEL_CFG_OPT_NMS, data["tiou"].get<float>());
+            pending_.nms = data["tiou"].get<float>();
+            pending_.model_epoch++;
         }
         if (data.contains("topk") && data["topk"].is_number_integer()) {
-            model_->setConfig(MA_MODEL_CFG_OPT_TOPK, data["tiou"].get<int32_t>());
+            pending_.topk = data["topk"].get<int32_t>();
+            pending_.model_epoch++;
         }
         if (data.contains("debug") && data["debug"].is_boolean()) {
-            debug_ = data["debug"].get<bool>();
+            pending_.debug = data["debug"].get<bool>();
+        }
+        if (data.contains("image") && data["image"].is_string()) {
+            pending_.binary_image = data["image"].get<std::string>() == "binary";
         }
+        if (data.contains("encode") && data["encode"].is_object()) {
+            pending_.encode.quality = data["encode"].value("quality", pending_.encode.quality);
+            pending_.encode.width   = data["encode"].value("width", pending_.encode.width);
+            pending_.encode.height  = data["encode"].value("height", pending_.encode.height);
+        }
+        // the publish stage owns the tracker and the counter, it resets them when it sees the new epoch
         if (data.contains("trace") && data["trace"].is_boolean()) {
-            trace_ = data["trace"].get<bool>();
-            tracker_.clear();
+            pending_.trace = data["trace"].get<bool>();
+            pending_.tracker_epoch++;
         }
         if (data.contains("counting") && data["counting"].is_boolean()) {
-            counting_ = data["counting"].get<bool>();
-            counter_.clear();
+            pending_.counting = data["counting"].get<bool>();
+            pending_.counter_epoch++;
         }
         if (data.contains("splitter") && data["splitter"].is_array()) {
-            counter_.setSplitter(data["splitter"].get<std::vector<int16_t>>());
+            pending_.splitter = data["splitter"].get<std::vector<int16_t>>();
+            pending_.splitter_epoch++;
+        }
+        if (data.contains("zones")) {
+            check(setZones(data["zones"]));
+        }
+        if (data.contains("motion")) {
+            setMotion(data["motion"]);
+        }
+        if (data.contains("tiling")) {
+            setTiling(data["tiling"]);
+        }
+        if (data.contains("rate")) {
+            setRate(data["rate"]);
+        }
+        if (data.contains("roi")) {
+            check(setRois(data["roi"]));
         }
-        server_->response(id_, json::object({{"type", MA_MSG_TYPE_RESP}, {"name", control}, {"code", MA_OK}, {"data", data}}));
+        if (data.contains("coords") && data["coords"].is_string()) {
+            check(setCoords(data["coords"].get<std::string>()));
+            pending_.emit_epoch++;
+        }
+        if (data.contains("emit")) {
+            check(setEmit(data["emit"]));
+        }
+        if (data.contains("queue") && data["queue"].is_number_integer()) {
+            check(server_->setPublishLimit(id_, data["queue"].get<int32_t>()));
+        }
+        if (data.contains("format") && data["format"].is_string()) {
+            check(server_->setFormat(id_, data["format"].get<std::string>()));
+            pending_.format = server_->getFormat(id_);
+        }
+        commit();
+        server_->response(id_, json::object({{"type", MA_MSG_TYPE_RESP}, {"name", control}, {"code", err}, {"data", data}}));
     } else {
         server_->response(id_, json::object({{"type", MA_MSG_TYPE_RESP}, {"name", control}, {"code", MA_ENOTSUP}, {"data", ""}}));
     }
@@ -383,10 +1254,14 @@ ma_err_t ModelNode::onDestroy() {
 
     onStop();
 
-    if (thread_ != nullptr) {
-        delete thread_;
-        thread_ = nullptr;
+    for (auto& thread : threads_) {
+        delete thread;
     }
+    threads_.clear();
+    for (auto& job : jobs_) {
+        delete job;
+    }
+    jobs_.clear();
     if (engine_ != nullptr) {
         delete engine_;
         engine_ = nullptr;
@@ -419,12 +1294,32 @@ ma_err_t ModelNode::onStart() {
         return MA_ENOTSUP;
     }
 
+    if (jobs_.empty()) {
+        int32_t width  = static_cast<const ma_img_t*>(model_->getInput())->width;
+        int32_t height = static_cast<const ma_img_t*>(model_->getInput())->height;
+        for (int i = 0; i < MODEL_PIPELINE_DEPTH; i++) {
+            ModelJob* job = new ModelJob();
+            job->image    = cv2::Mat(height, width, CV_8UC3);
+            jobs_.push_back(job);
+        }
+    }
+    for (auto& job : jobs_) {
+        job->encoding.store(false);  // a cancelled encode never called back
+        free_.post(job);
+    }
+    ready_depth_ = 0;
+    done_depth_  = 0;
+
+    // over the rate the controller allows, the camera does not even decode the capture for this node
+    frame_.setGate(&rate_);
     camera_->attach(&frame_);
 
     MA_LOGI(TAG, "start model: %s(%s)", type_.c_str(), id_.c_str());
     started_ = true;
 
-    thread_->start(this);
+    for (auto& thread : threads_) {
+        thread->start(this);
+    }
 
     return MA_OK;
 }
@@ -436,17 +1331,32 @@ ma_err_t ModelNode::onStop() {
     }
     started_ = false;
 
-    if (thread_ != nullptr) {
-        thread_->join();
+    for (auto& thread : threads_) {
+        thread->join();
     }
 
+    // a pending debug image still calls back into this node
+    JpegEncoder::instance()->cancel(this);
+
     if (camera_ != nullptr) {
         camera_->detach(&frame_);
     }
 
+    // drop the reference still pending for us
+    frame_.clear();
+
+    // every job is parked in one of the queues now, onStart refills the free list
+    ModelJob* job = nullptr;
+    while (free_.fetch(reinterpret_cast<void**>(&job), Tick::fromMilliseconds(0))) {
+    }
+    while (ready_.fetch(reinterpret_cast<void**>(&job), Tick::fromMilliseconds(0))) {
+    }
+    while (done_.fetch(reinterpret_cast<void**>(&job), Tick::fromMilliseconds(0))) {
+    }
+
     return MA_OK;
 }
 
-REGISTER_NODE_SINGLETON("model", ModelNode);
+REGISTER_NODE("model", ModelNode);
 
 }  // namespace ma::node
\ No newline at end of file
@@ -1,19 +1,147 @@
 
 #pragma once
 
-#include "extension/bytetrack/byte_tracker.h"
+#include <array>
+#include <atomic>
+#include <memory>
+
 #include "extension/counter/counter.h"
 
 #include "node.h"
 #include "server.h"
 
 #include "camera.h"
+#include "emitter.h"
+#include "letterbox.h"
+#include "motion.h"
+#include "rate.h"
+#include "tracker.h"
+#include "writer.h"
+#include "zone.h"
 
 namespace ma::node {
 
+// part of the camera frame letterboxed to the model input on its own, e.g. a tile
+struct ModelCrop {
+    cv2::Rect rect;  // camera frame pixels
+    cv2::Mat image;  // letterboxed RGB model input
+    int32_t left;
+    int32_t top;
+    int32_t scaled_width;
+    int32_t scaled_height;
+    ma_tick_t preprocess;
+    ma_perf_t perf;
+};
+
+// one frame in flight through the pre-process -> inference -> publish stages
+struct ModelJob {
+    int32_t count;
+    ma_err_t err;
+    bool skipped;    // static scene, the results are those of the last inference
+    bool global;     // the whole frame goes through the model, not only the crops
+    cv2::Mat image;  // letterboxed RGB model input of the whole frame
+    std::atomic<bool> encoding;  // image handed to the encoder for the debug image, cleared by its callback
+    std::vector<ModelCrop> crops;
+    std::vector<cv2::Rect> rois;  // camera frame pixels
+    uint32_t sequence;            // capture count of the camera
+    ma_tick_t timestamp;          // capture
+    ma_tick_t dequeued;           // stage boundaries, for the trace
+    ma_tick_t prepared;
+    ma_tick_t started;
+    ma_tick_t inferred;
+    // camera frame and where it landed in the model input, results of the crops are mapped here too
+    int32_t frame_width;
+    int32_t frame_height;
+    int32_t left;
+    int32_t top;
+    int32_t scaled_width;
+    int32_t scaled_height;
+    ma_tick_t preprocess;
+    ma_tick_t inference;
+    ma_perf_t perf;
+    std::vector<ma_bbox_t> boxes;
+    std::vector<ma_class_t> classes;
+    std::vector<ma_keypoint3f_t> keypoints;
+    std::vector<ma_segm2f_t> segments;
+};
+
 class ModelNode : public Node {
 
 public:
+    // space of the published coordinates: model input pixels, camera frame pixels or 0..1 of the frame
+    enum class Coords {
+        MODEL,
+        FRAME,
+        NORMALIZED,
+    };
+
+    // overlapping tiles of the frame, each one letterboxed to the model input on its own
+    struct Tiling {
+        int32_t cols;
+        int32_t rows;
+        float overlap;  // fraction of a tile shared with its neighbour, at least
+        bool global;    // also run the whole frame, for objects larger than a tile
+        float iou;      // cross-tile NMS threshold
+    };
+
+    // scene change gate in front of the model
+    struct Motion {
+        bool enabled;
+        int32_t threshold;  // luma levels
+        float area;         // fraction of the blocks
+        int32_t interval;   // frames skipped at most, 0 never forces one through
+        bool repeat;        // a skipped frame repeats the last result instead of publishing nothing
+    };
+
+    // publish-on-change
+    struct Emit {
+        bool enabled;
+        float tolerance;   // 0..1 of the model input
+        int32_t score;     // percent points
+        int32_t keyframe;  // ms between full states
+    };
+
+    // admission control, 0 disables either
+    struct Rate {
+        float fps;
+        int32_t latency;  // ms, end-to-end budget
+    };
+
+    // what the control plane may change while the pipeline runs. onControl only edits its own copy under
+    // mutex_ and publishes it whole, it never touches the pipeline's state itself; each stage takes the
+    // current snapshot once per frame and works from it alone, so no stage sees half an update. Settings
+    // with state behind them are applied by the stage that owns that state when it sees a new epoch: the
+    // motion gate and the rate controller by the pre-process stage (the camera asks the latter for admission,
+    // behind its own mutex), the model thresholds by the inference stage, the tracker, the counter, the zones
+    // and the emitter by the publish stage.
+    struct Options {
+        bool debug;
+        bool binary_image;  // debug JPEG as raw bytes on "<out>/<id>/image", count first, instead of base64 in the result
+        JpegEncoder::Options encode;
+        NodeServer::Format format;  // results are written in it, see NodeServer::setFormat
+        bool trace;
+        bool counting;
+        Coords coords;
+        Tiling tiling;
+        Motion motion;
+        Emit emit;
+        Rate rate;
+        std::vector<std::array<float, 4>> rois;  // x, y, w, h in percent of the frame
+        json zones;                              // validated, see ZoneCounter::configure
+        std::vector<int16_t> splitter;
+        float threshold;  // model thresholds, < 0 leaves the model's own
+        float nms;
+        int32_t topk;
+        uint32_t model_epoch;     // thresholds changed
+        uint32_t tracker_epoch;   // tracking restarts: tracker, zones and publish-on-change state
+        uint32_t counter_epoch;   // counting restarts
+        uint32_t splitter_epoch;  // splitter changed
+        uint32_t motion_epoch;    // motion gate reconfigured, its reference and statistics restart
+        uint32_t emit_epoch;      // emitter reconfigured, or the published space changed: next frame is a keyframe
+        uint32_t rate_epoch;      // rate controller reconfigured
+        uint32_t zones_epoch;     // zones replaced, their counts restart
+    };
+
     ModelNode(std::string id);
     ~ModelNode();
 
@@ -25,25 +153,91 @@ public:
 
 
 protected:
-    void threadEntry();
-    static void threadEntryStub(void* obj);
+    // what the publish stage keeps between frames, a steady scene is written out without allocating
+    struct PublishState {
+        int32_t width;  // model input
+        int32_t height;
+        ma_output_type_t type;
+        std::string payload;  // swapped for a spare buffer of the server on every send
+        size_t image;         // where the debug image goes, see JsonWriter::empty()
+        size_t publish;       // trace values the server patches, see JsonWriter::fixed()
+        size_t send;
+        std::vector<int> tracks;
+        std::vector<float> xs;  // box centres in percent of the published space, for the counters
+        std::vector<float> ys;
+        std::vector<ChangeEmitter::Item> items;
+        std::vector<size_t> added;
+        std::vector<size_t> updated;
+        std::vector<int32_t> removed;
+        std::vector<int> counts;  // the counter hands out copies, kept as plain arrays and written as they are
+        std::vector<int> last_counts;
+        std::vector<int16_t> splitter;
+        uint32_t suppressed;  // frames not sent since the last message, publish-on-change
+        uint32_t tracker_epoch;
+        uint32_t counter_epoch;
+        uint32_t splitter_epoch;
+        uint32_t zones_epoch;
+        uint32_t emit_epoch;
+        ma_tick_t start;  // of the current frame
+        ma_tick_t last;   // the previous frame through this stage
+    };
+
+    // the snapshot the pipeline uses, and publishing pending_ as the next one
+    std::shared_ptr<const Options> options() const;
+    void commit();
+
+    ma_err_t setCoords(const std::string& coords);
+    ma_err_t setEmit(const json& emit);
+    void setMotion(const json& motion);
+    void setTiling(const json& tiling);
+    ma_err_t setRois(const json& rois);
+    void setRate(const json& rate);
+    ma_err_t setZones(const json& zones);
+
+    // runs one model input, the results are appended to the job in the coordinates of its whole frame
+    ma_err_t invoke(cv2::Mat& image, ModelJob* job, const ModelCrop* crop);
+    // cross-crop NMS, an object seen by overlapping crops is kept once
+    void merge(ModelJob* job, float threshold);
+    // one job through the publish stage, false when publish-on-change leaves nothing to send
+    bool build(ModelJob* job, const Options& options, PublishState& state);
+
+    void preprocessEntry();
+    void inferenceEntry();
+    void publishEntry();
+    static void preprocessEntryStub(void* obj);
+    static void inferenceEntryStub(void* obj);
+    static void publishEntryStub(void* obj);
+
+    // the allocation check of the sscma-node-alloc target, it runs build() on synthetic jobs
+    friend int benchmarkAllocations(int frames);
 
 protected:
     std::string uri_;
     int32_t times_;
     int32_t count_;
-    bool debug_;
-    bool trace_;
-    bool counting_;
+    Options pending_;                         // control plane copy, under mutex_
+    std::shared_ptr<const Options> options_;  // std::atomic_load / std::atomic_store only
     json info_;
     Model* model_;
     Engine* engine_;
-    BYTETracker tracker_;
+    Tracker tracker_;
     Counter counter_;
+    ChangeEmitter emitter_;
+    ZoneCounter zones_;  // tripwires and polygons on the track stream, next to the single splitter line
+    Letterbox letterbox_;
+    std::vector<Letterbox> crop_letterboxes_;  // one per crop, keeps the sampling tables cached
+    MotionGate motion_;
     std::vector<std::string> labels_;
-    Thread* thread_;
+    std::vector<Thread*> threads_;
     CameraNode* camera_;
-    MessageBox frame_;
+    FrameMailbox frame_;  // latest frame wins, a busy pipeline never holds up the camera
+    RateController rate_;
+    std::vector<ModelJob*> jobs_;
+    MessageBox free_;
+    MessageBox ready_;
+    MessageBox done_;
+    std::atomic<int32_t> ready_depth_;
+    std::atomic<int32_t> done_depth_;
 };
 
 
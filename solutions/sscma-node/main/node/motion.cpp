@@ -0,0 +1,100 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "motion.h"
+
+namespace ma::node {
+
+#define MOTION_GRID_COLS   32
+#define MOTION_GRID_ROWS   18
+#define MOTION_SAMPLE_STEP 4
+
+MotionGate::MotionGate() : enabled_(false), threshold_(12), area_(0.01f), interval_(0), skipped_(0), frames_total_(0), skipped_total_(0), width_(0), height_(0) {}
+
+void MotionGate::configure(bool enabled, int threshold, float area, int interval) {
+    Guard guard(mutex_);
+    enabled_   = enabled;
+    threshold_ = std::max(threshold, 1);
+    area_      = std::min(std::max(area, 0.0f), 1.0f);
+    interval_  = std::max(interval, 0);
+    reference_.clear();
+    skipped_       = 0;
+    frames_total_  = 0;
+    skipped_total_ = 0;
+}
+
+void MotionGate::reset() {
+    Guard guard(mutex_);
+    reference_.clear();
+    skipped_ = 0;
+}
+
+void MotionGate::stats(uint32_t& frames, uint32_t& skipped) {
+    Guard guard(mutex_);
+    frames  = frames_total_;
+    skipped = skipped_total_;
+}
+
+void MotionGate::measure(const uint8_t* bgr, int width, int height, size_t stride) {
+    if (width != width_ || height != height_) {
+        width_  = width;
+        height_ = height;
+        columns_.resize((width + MOTION_SAMPLE_STEP - 1) / MOTION_SAMPLE_STEP);
+        for (size_t i = 0; i < columns_.size(); i++) {
+            columns_[i] = static_cast<int32_t>(i * MOTION_SAMPLE_STEP * MOTION_GRID_COLS / width);
+        }
+        reference_.clear();
+    }
+
+    sums_.assign(MOTION_GRID_COLS * MOTION_GRID_ROWS, 0);
+    counts_.assign(MOTION_GRID_COLS * MOTION_GRID_ROWS, 0);
+    for (int y = 0; y < height; y += MOTION_SAMPLE_STEP) {
+        const uint8_t* row = bgr + y * stride;
+        uint32_t* sums     = sums_.data() + (y * MOTION_GRID_ROWS / height) * MOTION_GRID_COLS;
+        uint32_t* counts   = counts_.data() + (y * MOTION_GRID_ROWS / height) * MOTION_GRID_COLS;
+        for (size_t i = 0; i < columns_.size(); i++) {
+            const uint8_t* px = row + i * MOTION_SAMPLE_STEP * 3;
+            // (B + 2G + R) / 4 is close enough to luma for a change test
+            sums[columns_[i]] += (px[0] + 2 * px[1] + px[2]) >> 2;
+            counts[columns_[i]]++;
+        }
+    }
+
+    current_.resize(sums_.size());
+    for (size_t i = 0; i < sums_.size(); i++) {
+        current_[i] = counts_[i] ? static_cast<uint8_t>(sums_[i] / counts_[i]) : 0;
+    }
+}
+
+bool MotionGate::check(const uint8_t* bgr, int width, int height, size_t stride) {
+    Guard guard(mutex_);
+    if (!enabled_ || bgr == nullptr || width <= 0 || height <= 0) {
+        return true;
+    }
+
+    measure(bgr, width, height, stride);
+    frames_total_++;
+
+    bool changed = reference_.size() != current_.size() || (interval_ > 0 && skipped_ >= interval_);
+    if (!changed) {
+        int moved = 0;
+        for (size_t i = 0; i < current_.size(); i++) {
+            if (std::abs(current_[i] - reference_[i]) > threshold_) {
+                moved++;
+            }
+        }
+        changed = moved > 0 && moved >= area_ * current_.size();
+    }
+
+    if (changed) {
+        reference_.swap(current_);
+        skipped_ = 0;
+        return true;
+    }
+
+    skipped_++;
+    skipped_total_++;
+    return false;
+}
+
+}  // namespace ma::node
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "core/ma_core.h"
+#include "porting/ma_osal.h"
+
+namespace ma::node {
+
+// Cheap scene change test in front of the model. The frame is reduced to the mean luma of a coarse grid
+// of blocks (every 4th pixel of every 4th row is sampled) and compared block by block with the grid of
+// the last frame that was let through, so a slow drift still adds up to a change eventually.
+class MotionGate {
+public:
+    MotionGate();
+    ~MotionGate() = default;
+
+    // threshold: luma levels a block has to move, area: fraction of the blocks that have to move,
+    // interval: consecutive frames skipped at most before one is let through anyway, 0 never forces
+    void configure(bool enabled, int threshold, float area, int interval);
+
+    // true when the frame has to go through the model, always true while disabled
+    bool check(const uint8_t* bgr, int width, int height, size_t stride);
+
+    // forget the reference, the next frame goes through
+    void reset();
+
+    // frames checked and frames skipped since the last configure()
+    void stats(uint32_t& frames, uint32_t& skipped);
+
+private:
+    void measure(const uint8_t* bgr, int width, int height, size_t stride);
+
+    Mutex mutex_;
+    bool enabled_;
+    int threshold_;
+    float area_;
+    int interval_;
+    int skipped_;
+    uint32_t frames_total_;
+    uint32_t skipped_total_;
+    int width_;
+    int height_;
+    std::vector<int32_t> columns_;    // grid column of every sampled pixel column
+    std::vector<uint32_t> sums_;      // luma sum per block
+    std::vector<uint32_t> counts_;    // samples per block
+    std::vector<uint8_t> current_;    // mean luma per block
+    std::vector<uint8_t> reference_;  // empty until the first frame
+};
+
+}  // namespace ma::node
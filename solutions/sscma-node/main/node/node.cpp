@@ -199,6 +199,7 @@ void NodeFactory::destroy(const std::string id) {
 }
 
 Node* NodeFactory::find(const std::string id) {
+    Guard guard(m_mutex);
     auto node = m_nodes.find(id);
     if (node == m_nodes.end()) {
         return nullptr;
@@ -0,0 +1,65 @@
+#include <algorithm>
+
+#include "rate.h"
+
+namespace ma::node {
+
+// adaptation steps of the latency controller, backs off fast and recovers slowly
+#define RATE_BACKOFF  1.25f
+#define RATE_RECOVER  0.95f
+#define RATE_HEADROOM 0.8f
+#define RATE_MAX_MS   2000.0f
+
+RateController::RateController() : fps_(0.0f), latency_(0), floor_(0.0f), interval_(0.0f), last_(0), dropped_(0) {}
+
+void RateController::configure(float fps, int32_t latency) {
+    Guard guard(mutex_);
+    fps_      = std::max(fps, 0.0f);
+    latency_  = std::max(latency, 0);
+    floor_    = fps_ > 0.0f ? 1000.0f / fps_ : 0.0f;
+    interval_ = floor_;
+    last_     = 0;
+    dropped_  = 0;
+}
+
+bool RateController::admit(ma_tick_t now) {
+    Guard guard(mutex_);
+    if (interval_ <= 0.0f) {
+        return true;
+    }
+    if (last_ != 0 && Tick::toMilliseconds(now - last_) < interval_) {
+        dropped_++;
+        return false;
+    }
+    last_ = now;
+    return true;
+}
+
+void RateController::feedback(ma_tick_t age) {
+    Guard guard(mutex_);
+    if (latency_ <= 0) {
+        return;
+    }
+    float ms = Tick::toMilliseconds(age);
+    if (ms > latency_) {
+        // start from the age itself, an open rate has no interval to scale yet
+        interval_ = std::min(std::max(interval_ * RATE_BACKOFF, ms - latency_), RATE_MAX_MS);
+    } else if (ms < latency_ * RATE_HEADROOM) {
+        interval_ = interval_ * RATE_RECOVER;
+        if (interval_ < std::max(floor_, 1.0f)) {
+            interval_ = floor_;
+        }
+    }
+}
+
+uint32_t RateController::dropped() {
+    Guard guard(mutex_);
+    return dropped_;
+}
+
+float RateController::interval() {
+    Guard guard(mutex_);
+    return interval_;
+}
+
+}  // namespace ma::node
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdint>
+
+#include "core/ma_core.h"
+#include "porting/ma_osal.h"
+
+namespace ma::node {
+
+// Admission control in front of the model pipeline, asked by the camera for every capture: frames are
+// dropped at the source, before they are decoded, converted or handed to the consumer.
+// A frame is admitted once at least interval() has passed since the previous one. A target fps fixes the
+// interval, a latency budget adapts it to the end-to-end age of the published results: it grows while
+// results come out late and shrinks again slowly once they are well within the budget.
+class RateController {
+public:
+    RateController();
+    ~RateController() = default;
+
+    // fps: 0 leaves the rate open, latency: budget in ms, 0 disables the adaptation
+    void configure(float fps, int32_t latency);
+
+    // true when the frame captured now should be processed
+    bool admit(ma_tick_t now);
+
+    // capture to publish of a result
+    void feedback(ma_tick_t age);
+
+    uint32_t dropped();
+    float interval();  // ms
+
+private:
+    Mutex mutex_;
+    float fps_;
+    int32_t latency_;
+    float floor_;     // ms, from the target fps
+    float interval_;  // ms
+    ma_tick_t last_;
+    uint32_t dropped_;
+};
+
+}  // namespace ma::node
@@ -1,3 +1,6 @@
+#include <chrono>
+#include <numeric>
+#include <stdio.h>
 
 #include "server.h"
 
@@ -9,6 +12,12 @@ namespace ma::node {
 
 static constexpr char TAG[] = "ma::node::server";
 
+// default number of pending events per node kept while the broker falls behind
+#define NODE_PUBLISH_LIMIT 4
+
+// sent pre-serialized events whose buffers are kept for reuse
+#define NODE_SPARE_BUFFERS 8
+
 void NodeServer::onConnect(struct mosquitto* mosq, int rc) {
     std::string topic = m_topic_in_prefix + "/+";
     mosquitto_subscribe(mosq, NULL, m_topic_in_prefix.c_str(), 0);
@@ -20,6 +29,32 @@ void NodeServer::onConnect(struct mosquitto* mosq, int rc) {
 
 void NodeServer::onDisconnect(struct mosquitto* mosq, int rc) {
     m_connected.store(false);
+    // whatever the client still had queued is gone with the connection, without an on_publish
+    Guard guard(m_mutex);
+    m_inflight.clear();
+    for (auto& count : m_inflight_count) {
+        count.second = 0;
+    }
+    if (!m_pending.empty()) {
+        m_pending_signal.signal();
+    }
+}
+
+// QoS 0 messages are written out in the order they were published, so the oldest one in flight is done
+void NodeServer::onPublish(struct mosquitto* mosq, int mid) {
+    Guard guard(m_mutex);
+    if (m_inflight.empty()) {
+        return;
+    }
+    size_t* count = m_inflight.front();
+    m_inflight.pop_front();
+    if (count != nullptr && *count > 0) {
+        (*count)--;
+    }
+    // events held back for this budget may go now
+    if (!m_pending.empty()) {
+        m_pending_signal.signal();
+    }
 }
 
 void NodeServer::onMessage(struct mosquitto* mosq, const struct mosquitto_message* msg) {
@@ -36,7 +71,13 @@ void NodeServer::onMessage(struct mosquitto* mosq, const struct mosquitto_messag
             MA_THROW(e);
         }
         MA_LOGV(TAG, "request: %s <== %s", id.c_str(), payload.dump().c_str());
-        m_executor.submit([this, id = std::move(id), payload = std::move(payload)]() -> bool {
+        // requests for the same node stay ordered, health probes jump the queue, clear runs alone
+        std::string name = payload["name"].get<std::string>();
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        int priority    = name == "health" ? Executor::PRIORITY_HIGH : Executor::PRIORITY_NORMAL;
+        bool exclusive  = name == "clear";
+        std::string key = id;
+        m_executor.submit(key, [this, id = std::move(id), payload = std::move(payload)]() -> bool {
             Exception e(MA_OK, "");
             std::string name = payload["name"].get<std::string>();
             std::transform(name.begin(), name.end(), name.begin(), ::tolower);
@@ -48,16 +89,22 @@ void NodeServer::onMessage(struct mosquitto* mosq, const struct mosquitto_messag
                         MA_THROW(e);
                     }
                     std::string type = data["type"].get<std::string>();
+                    // whatever an earlier node of this id (or a failed create) left behind
+                    if (NodeFactory::find(id) == nullptr) {
+                        forget(id);
+                    }
                     if (NodeFactory::create(id, type, data, this) == nullptr) {
                         e = Exception(MA_EINVAL, "invalid payload");
                         MA_THROW(Exception(MA_EINVAL, "invalid payload"));
                     }
                 } else if (name == "destroy") {
                     NodeFactory::destroy(id);
+                    forget(id);
                     this->response(id, json::object({{"type", MA_MSG_TYPE_RESP}, {"name", name}, {"code", MA_OK}, {"data", ""}}));
                 } else if (name == "clear") {
                     MA_LOGD(TAG, "clear all nodes");
                     NodeFactory::clear();
+                    forget();
                     this->response(id, json::object({{"type", MA_MSG_TYPE_RESP}, {"name", name}, {"code", MA_OK}, {"data", ""}}));
                 } else if (name == "health") {
                     this->response(id, json::object({{"type", MA_MSG_TYPE_RESP}, {"name", name}, {"code", MA_OK}, {"data", ""}}));
@@ -80,7 +127,7 @@ void NodeServer::onMessage(struct mosquitto* mosq, const struct mosquitto_messag
                 return false;
             }
             return false;
-        });
+        }, priority, exclusive);
     }
     MA_CATCH(const Exception& e) {
         response(id, json::object({{"type", MA_MSG_TYPE_RESP}, {"name", "request"}, {"code", e.err()}, {"data", e.what()}}));
@@ -115,19 +162,276 @@ void NodeServer::onMessageStub(struct mosquitto* mosq, void* obj, const struct m
     }
 }
 
-void NodeServer::response(const std::string& id, const json& msg) {
+void NodeServer::onPublishStub(struct mosquitto* mosq, void* obj, int mid) {
+
+    NodeServer* server = static_cast<NodeServer*>(obj);
+    if (server) {
+        server->onPublish(mosq, mid);
+    }
+}
+
+void NodeServer::response(const std::string& id, json msg) {
+
+    if (!m_connected) {
+        return;
+    }
+
+    // responses are always delivered, events may be dropped oldest first
+    bool droppable = msg.contains("type") && msg["type"] == MA_MSG_TYPE_EVT;
+    Format format  = Format::JSON;
+
+    {
+        Guard guard(m_mutex);
+        if (droppable) {
+            auto it = m_format.find(id);
+            if (it != m_format.end()) {
+                format = it->second;
+            }
+        }
+    }
+
+    enqueue({id, id, "", std::move(msg), {}, droppable, format});
+}
+
+void NodeServer::response(const std::string& id, std::string& payload, Format format, size_t publish, size_t send) {
 
     if (!m_connected) {
         return;
     }
-    // Guard guard(m_mutex);
-    std::string topic = m_topic_out_prefix + '/' + id;
-    MA_LOGV(TAG, "response: %s ==> %s", id.c_str(), msg.dump().c_str());
-    int mid = mosquitto_publish(m_client, nullptr, topic.c_str(), msg.dump().size(), msg.dump().data(), 0, false);
-    return;
+
+    Outgoing out = {id, id, "", json(), {}, true, format};
+    {
+        Guard guard(m_mutex);
+        out.text.swap(payload);
+        if (!m_spare.empty()) {
+            payload.swap(m_spare.back());
+            m_spare.pop_back();
+        }
+    }
+    out.publish_at = publish;
+    out.send_at    = send;
+
+    enqueue(std::move(out));
+}
+
+void NodeServer::publish(const std::string& id, const std::string& channel, uint32_t sequence, std::vector<uint8_t> payload) {
+
+    if (!m_connected) {
+        return;
+    }
+
+    if (payload.size() < NODE_PUBLISH_HEADER) {
+        return;
+    }
+
+    // one topic per channel however many frames go out, the sequence travels in the payload
+    payload[0] = static_cast<uint8_t>(sequence >> 24);
+    payload[1] = static_cast<uint8_t>(sequence >> 16);
+    payload[2] = static_cast<uint8_t>(sequence >> 8);
+    payload[3] = static_cast<uint8_t>(sequence);
+
+    enqueue({id, id + '/' + channel, channel, json(), std::move(payload), true, Format::JSON});
+}
+
+void NodeServer::enqueue(Outgoing&& out) {
+    out.enqueued = Tick::current();
+    {
+        Guard guard(m_mutex);
+        if (out.droppable) {
+            // the budget covers what the client has not written out yet too, only the queued ones can go
+            size_t max    = limit(out.id);
+            size_t& count = m_pending_count[out.key];
+            if (max > 0 && count + m_inflight_count[out.key] >= max) {
+                for (auto pending = m_pending.begin(); pending != m_pending.end(); ++pending) {
+                    if (pending->droppable && pending->key == out.key) {
+                        MA_LOGV(TAG, "drop: %s", out.key.c_str());
+                        m_pending.erase(pending);
+                        count--;
+                        break;
+                    }
+                }
+            }
+            count++;
+        }
+        m_pending.push_back(std::move(out));
+    }
+    m_pending_signal.signal();
+}
+
+size_t NodeServer::limit(const std::string& id) const {
+    auto it = m_publish_limit.find(id);
+    return it != m_publish_limit.end() ? it->second : NODE_PUBLISH_LIMIT;
+}
+
+void NodeServer::send(const Outgoing& out, const void* data, size_t size) {
+    size_t* count = nullptr;
+    {
+        Guard guard(m_mutex);
+        if (out.droppable) {
+            count = &m_inflight_count[out.key];
+        }
+        m_inflight.push_back(count);
+    }
+    if (mosquitto_publish(m_client, nullptr, m_topic.c_str(), size, data, 0, false) != MOSQ_ERR_SUCCESS) {
+        // never queued, no on_publish will come; only this thread appends, so the last entry is this one
+        Guard guard(m_mutex);
+        if (!m_inflight.empty()) {
+            m_inflight.pop_back();
+        }
+        if (count != nullptr && *count > 0) {
+            (*count)--;
+        }
+    }
+}
+
+ma_err_t NodeServer::setPublishLimit(const std::string& id, int32_t limit) {
+    if (limit < 0) {
+        return MA_EINVAL;
+    }
+    Guard guard(m_mutex);
+    m_publish_limit[id] = static_cast<size_t>(limit);
+    return MA_OK;
+}
+
+// a node created again under the same id starts from the defaults
+void NodeServer::forget(const std::string& id) {
+    Guard guard(m_mutex);
+    m_publish_limit.erase(id);
+    m_format.erase(id);
+}
+
+void NodeServer::forget() {
+    Guard guard(m_mutex);
+    m_publish_limit.clear();
+    m_format.clear();
+}
+
+ma_err_t NodeServer::setFormat(const std::string& id, const std::string& format) {
+    Format value = Format::JSON;
+    if (format == "json") {
+        value = Format::JSON;
+    } else if (format == "cbor") {
+        value = Format::CBOR;
+    } else if (format == "msgpack") {
+        value = Format::MSGPACK;
+    } else {
+        return MA_EINVAL;
+    }
+    Guard guard(m_mutex);
+    m_format[id] = value;
+    return MA_OK;
+}
+
+NodeServer::Format NodeServer::getFormat(const std::string& id) {
+    Guard guard(m_mutex);
+    auto it = m_format.find(id);
+    return it != m_format.end() ? it->second : Format::JSON;
+}
+
+void NodeServer::publishEntry() {
+    std::deque<Outgoing> batch;
+
+    while (m_sending.load()) {
+        if (!m_pending_signal.wait(Tick::fromSeconds(1))) {
+            continue;
+        }
+
+        // take the whole burst at once, the producers keep appending to an empty queue meanwhile; events of a
+        // node whose budget is all in flight stay queued, newer ones replace them until the broker catches up
+        {
+            Guard guard(m_mutex);
+            for (size_t i = m_pending.size(); i > 0; i--) {
+                Outgoing& out = m_pending.front();
+                if (out.droppable) {
+                    size_t max       = limit(out.id);
+                    size_t& inflight = m_inflight_count[out.key];
+                    if (max > 0 && inflight >= max) {
+                        m_pending.push_back(std::move(out));
+                        m_pending.pop_front();
+                        continue;
+                    }
+                    inflight++;
+                    m_pending_count[out.key]--;
+                }
+                batch.push_back(std::move(out));
+                m_pending.pop_front();
+            }
+        }
+
+        for (auto& out : batch) {
+            m_topic.assign(m_topic_out_prefix).append(1, '/').append(out.id);
+
+            if (!out.channel.empty()) {
+                // raw side channel payload, published as is
+                m_topic.append(1, '/').append(out.channel);
+                MA_LOGV(TAG, "publish: %s ==> %zu bytes", m_topic.c_str(), out.raw.size());
+                send(out, out.raw.data(), out.raw.size());
+                continue;
+            }
+
+            // a traced result learns its wait in this queue, and how long the previous one took to go out
+            ma_tick_t send_start = Tick::current();
+            if (!out.text.empty()) {
+                // written by the node in its format already, the trace is patched in place
+                if (out.publish_at > 0 && out.send_at > out.publish_at && out.send_at < out.text.size()) {
+                    JsonWriter::patch(out.text, out.format, out.publish_at, static_cast<uint32_t>(Tick::toMilliseconds(send_start - out.enqueued)));
+                    JsonWriter::patch(out.text, out.format, out.send_at, m_send_time[out.id]);
+                }
+                if (out.format == Format::JSON) {
+                    MA_LOGV(TAG, "response: %s ==> %s", out.id.c_str(), out.text.c_str());
+                } else {
+                    m_topic.append(out.format == Format::CBOR ? "/cbor" : "/msgpack");
+                    MA_LOGV(TAG, "response: %s ==> %zu bytes", m_topic.c_str(), out.text.size());
+                }
+                send(out, out.text.data(), out.text.size());
+                m_send_time[out.id] = Tick::toMilliseconds(Tick::current() - send_start);
+                {
+                    Guard guard(m_mutex);
+                    if (m_spare.size() < NODE_SPARE_BUFFERS) {
+                        out.text.clear();
+                        m_spare.push_back(std::move(out.text));
+                    }
+                }
+                continue;
+            } else if (out.droppable && out.msg.contains("data") && out.msg["data"].is_object()) {
+                auto trace = out.msg["data"].find("trace");
+                if (trace != out.msg["data"].end() && trace->is_object()) {
+                    (*trace)["publish"] = Tick::toMilliseconds(send_start - out.enqueued);
+                    (*trace)["send"]    = m_send_time[out.id];
+                }
+            }
+
+            // serialize exactly once, the binary formats into the reused buffer; a DOM allocates anyway
+            if (out.format == Format::JSON) {
+                m_buffer = out.msg.dump();
+
+                MA_LOGV(TAG, "response: %s ==> %s", out.id.c_str(), m_buffer.c_str());
+                send(out, m_buffer.data(), m_buffer.size());
+            } else {
+                m_binary.clear();
+                if (out.format == Format::CBOR) {
+                    json::to_cbor(out.msg, m_binary);
+                    m_topic.append("/cbor");
+                } else {
+                    json::to_msgpack(out.msg, m_binary);
+                    m_topic.append("/msgpack");
+                }
+
+                MA_LOGV(TAG, "response: %s ==> %zu bytes", m_topic.c_str(), m_binary.size());
+                send(out, m_binary.data(), m_binary.size());
+            }
+            m_send_time[out.id] = Tick::toMilliseconds(Tick::current() - send_start);
+        }
+        batch.clear();
+    }
+}
+
+void NodeServer::publishEntryStub(void* obj) {
+    static_cast<NodeServer*>(obj)->publishEntry();
 }
 
-NodeServer::NodeServer(std::string client_id) : m_client(nullptr), m_connected(false), m_client_id(std::move(client_id)), m_mutex() {
+NodeServer::NodeServer(std::string client_id)
+    : m_client(nullptr), m_connected(false), m_client_id(std::move(client_id)), m_mutex(), m_sender(nullptr), m_sending(false), m_pending_signal(0) {
     mosquitto_lib_init();
 
     m_client = mosquitto_new(m_client_id.c_str(), true, this);
@@ -136,6 +440,7 @@ NodeServer::NodeServer(std::string client_id) : m_client(nullptr), m_connected(f
     mosquitto_connect_callback_set(m_client, onConnectStub);
     mosquitto_disconnect_callback_set(m_client, onDisconnectStub);
     mosquitto_message_callback_set(m_client, onMessageStub);
+    mosquitto_publish_callback_set(m_client, onPublishStub);
 
     m_topic_in_prefix  = std::string("sscma/v0/" + m_client_id + "/node/in");
     m_topic_out_prefix = std::string("sscma/v0/" + m_client_id + "/node/out");
@@ -161,6 +466,12 @@ ma_err_t NodeServer::start(std::string host, int port, std::string username, std
 
     mosquitto_loop_start(m_client);
 
+    if (m_sender == nullptr) {
+        m_sending.store(true);
+        m_sender = new Thread("node#sender", &NodeServer::publishEntryStub, this);
+        m_sender->start(this);
+    }
+
     mosquitto_reconnect_delay_set(m_client, 2, 30, true);
     if (username.length() > 0 && password.length() > 0) {
         mosquitto_username_pw_set(m_client, username.c_str(), password.c_str());
@@ -174,6 +485,13 @@ ma_err_t NodeServer::start(std::string host, int port, std::string username, std
 }
 
 ma_err_t NodeServer::stop() {
+    if (m_sender != nullptr) {
+        m_sending.store(false);
+        m_pending_signal.signal();
+        m_sender->join();
+        delete m_sender;
+        m_sender = nullptr;
+    }
     if (m_client && m_connected.load()) {
         mosquitto_disconnect(m_client);
         mosquitto_loop_stop(m_client, true);
@@ -181,4 +499,180 @@ ma_err_t NodeServer::stop() {
     return MA_OK;
 }
 
+// answers every request at once, so a round trip is the server and the executor alone
+class EchoNode : public Node {
+public:
+    EchoNode(std::string id) : Node("echo", std::move(id)) {}
+
+    ma_err_t onCreate(const json& config) override {
+        created_ = true;
+        server_->response(id_, json::object({{"type", MA_MSG_TYPE_RESP}, {"name", "create"}, {"code", MA_OK}, {"data", ""}}));
+        return MA_OK;
+    }
+    ma_err_t onStart() override {
+        started_ = true;
+        return MA_OK;
+    }
+    ma_err_t onControl(const std::string& control, const json& data) override {
+        server_->response(id_, json::object({{"type", MA_MSG_TYPE_RESP}, {"name", control}, {"code", MA_OK}, {"data", data}}));
+        return MA_OK;
+    }
+    ma_err_t onStop() override {
+        started_ = false;
+        return MA_OK;
+    }
+    ma_err_t onDestroy() override {
+        return MA_OK;
+    }
+};
+
+int benchmarkExecutor(int requests) {
+    // nodes with a request in flight at the same time, each one its own executor key
+    const int concurrency[] = {1, 2, 4, 8};
+    const char* names[]     = {"create", "config", "destroy"};
+
+    NodeFactory::registerNode("echo", [](const std::string& id) { return new EchoNode(id); });
+
+    // replies pile up in the pending queue, the sender thread is never started
+    NodeServer server("bench");
+    server.m_connected.store(true);
+
+    std::vector<std::string> topics;
+    std::vector<std::string> payloads;
+    std::vector<std::chrono::steady_clock::time_point> sent;
+    std::vector<double> times[3];
+
+    printf("%8s %8s %10s %10s %10s %10s\n", "nodes", "request", "mean(us)", "p50(us)", "p99(us)", "max(us)");
+    for (int nodes : concurrency) {
+        topics.clear();
+        for (int n = 0; n < nodes; n++) {
+            topics.push_back(server.m_topic_in_prefix + "/echo" + std::to_string(n));
+        }
+        for (auto& t : times) {
+            t.clear();
+        }
+        payloads = {json::object({{"name", "create"}, {"data", {{"type", "echo"}, {"config", json::object()}}}}).dump(),
+                    json::object({{"name", "config"}, {"data", {{"threshold", 50}}}}).dump(),
+                    json::object({{"name", "destroy"}, {"data", ""}}).dump()};
+        sent.resize(nodes);
+
+        for (int r = 0; r < std::max(requests, 1); r++) {
+            for (int k = 0; k < 3; k++) {
+                // one request per node at once, then wait for all of their replies
+                for (int n = 0; n < nodes; n++) {
+                    struct mosquitto_message msg = {};
+                    msg.topic                    = &topics[n][0];
+                    msg.payload                  = &payloads[k][0];
+                    msg.payloadlen               = payloads[k].size();
+                    sent[n]                      = std::chrono::steady_clock::now();
+                    server.onMessage(server.m_client, &msg);
+                }
+                for (int replies = 0; replies < nodes;) {
+                    if (!server.m_pending_signal.wait(Tick::fromSeconds(1))) {
+                        fprintf(stderr, "no reply to %s\n", names[k]);
+                        server.m_connected.store(false);
+                        NodeFactory::clear();
+                        return 1;
+                    }
+                    auto now = std::chrono::steady_clock::now();
+                    Guard guard(server.m_mutex);
+                    while (!server.m_pending.empty()) {
+                        int n = std::atoi(server.m_pending.front().id.c_str() + 4);
+                        times[k].push_back(std::chrono::duration<double, std::micro>(now - sent[n]).count());
+                        server.m_pending.pop_front();
+                        replies++;
+                    }
+                }
+            }
+        }
+
+        for (int k = 0; k < 3; k++) {
+            std::vector<double>& t = times[k];
+            std::sort(t.begin(), t.end());
+            double mean = std::accumulate(t.begin(), t.end(), 0.0) / t.size();
+            printf("%8d %8s %10.1f %10.1f %10.1f %10.1f\n", nodes, names[k], mean, t[t.size() / 2], t[std::min(t.size() - 1, t.size() * 99 / 100)], t.back());
+        }
+    }
+
+    server.m_connected.store(false);
+    NodeFactory::clear();
+    return 0;
+}
+
+int benchmarkFormat(int iterations) {
+    const char* outputs[] = {"boxes", "keypoints", "segments"};
+    const int sizes[]     = {1, 10, 100};
+
+    iterations = std::max(iterations, 1);
+
+    std::string text;
+    std::string binary;
+    std::string dump;
+    auto time = [&](const std::function<void()>& encode) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; i++) {
+            encode();
+        }
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / iterations;
+    };
+
+    // all three written by JsonWriter the way the model node does it, each decoded back and checked against the
+    // JSON; dump is the same message through a DOM, for reference
+    printf("%10s %8s %10s %10s %10s %10s %10s %10s %10s\n", "output", "objects", "json(B)", "cbor(B)", "msgpack(B)", "json(us)", "cbor(us)", "msgpack(us)", "dump(us)");
+    for (const char* output : outputs) {
+        for (int n : sizes) {
+            // shaped like a model result in model input pixels, values spread like real ones
+            auto write = [&](std::string& out, NodeServer::Format format) {
+                out.clear();
+                JsonWriter writer(out, format);
+                writer.beginObject().key("type").value(static_cast<int32_t>(MA_MSG_TYPE_EVT)).key("name").value("invoke").key("code").value(static_cast<int32_t>(MA_OK));
+                writer.key("data").beginObject().key("count").value(1234).key("resolution").beginArray().value(640).value(640).endArray();
+                writer.key("labels").beginArray();
+                for (int i = 0; i < n; i++) {
+                    writer.value("person");
+                }
+                writer.endArray().key(output).beginArray();
+                for (int i = 0; i < n; i++) {
+                    if (std::string(output) != "boxes") {
+                        writer.beginArray();
+                    }
+                    writer.beginArray().value((i * 37) % 640).value((i * 53) % 640).value(20 + i % 100).value(40 + i % 200).value(50 + i % 50).value(i % 80).endArray();
+                    if (std::string(output) == "keypoints") {
+                        writer.beginArray();
+                        for (int k = 0; k < 17; k++) {
+                            writer.beginArray().value((i * 37 + k * 7) % 640).value((i * 53 + k * 11) % 640).value(30 + k * 4).endArray();
+                        }
+                        writer.endArray().endArray();
+                    } else if (std::string(output) == "segments") {
+                        writer.beginArray().value(160).value(160).endArray().endArray();
+                    }
+                }
+                writer.endArray();
+                writer.key("perf").beginArray().beginArray().value(3).value(25).value(2).endArray().endArray();
+                writer.key("image").value("").endObject().endObject();
+            };
+
+            double json_time = time([&]() { write(text, NodeServer::Format::JSON); });
+            json msg         = json::parse(text, nullptr, false);
+            double dump_time = time([&]() { dump = msg.dump(); });
+            double cbor_time = time([&]() { write(binary, NodeServer::Format::CBOR); });
+            size_t cbor_size = binary.size();
+            if (json::from_cbor(binary, true, false) != msg) {
+                MA_LOGE(TAG, "cbor differs: %s x %d", output, n);
+                return 1;
+            }
+            double msgpack_time = time([&]() { write(binary, NodeServer::Format::MSGPACK); });
+            size_t msgpack_size = binary.size();
+            if (json::from_msgpack(binary, true, false) != msg) {
+                MA_LOGE(TAG, "msgpack differs: %s x %d", output, n);
+                return 1;
+            }
+
+            printf("%10s %8d %10zu %10zu %10zu %10.2f %10.2f %10.2f %10.2f\n", output, n, text.size(), cbor_size, msgpack_size, json_time, cbor_time, msgpack_time, dump_time);
+        }
+    }
+
+    return 0;
+}
+
 }  // namespace ma::node
\ No newline at end of file
@@ -1,15 +1,24 @@
 #pragma once
 
+#include <deque>
 #include <string>
+#include <unordered_map>
 
 #include <mosquitto.h>
 
 #include "executor.hpp"
 #include "node.h"
+#include "writer.h"
 namespace ma::node {
 
+// bytes in front of a side channel payload, the big endian sequence
+#define NODE_PUBLISH_HEADER 4
+
 class NodeServer {
 public:
+    // encoding of event payloads, binary formats are published on "<out>/<id>/cbor" or "<out>/<id>/msgpack"
+    using Format = JsonWriter::Format;
+
     NodeServer(std::string client_id);
     ~NodeServer();
 
@@ -17,17 +26,66 @@ public:
     ma_err_t stop();
 
     // void dispatch(const std::string& id, const json& msg);
-    void response(const std::string& id, const json& msg);
+    // queue a message for the sender thread, never blocks on the broker
+    void response(const std::string& id, json msg);
+
+    // queue an event already serialized in format, payload is swapped for a spare buffer of an earlier message
+    // so a node writing its events this way keeps reusing the same few buffers; publish and send are the
+    // offsets of the JsonWriter::fixed() values of its trace the sender patches, 0 when it has none
+    void response(const std::string& id, std::string& payload, Format format, size_t publish = 0, size_t send = 0);
+
+    // raw payload on the fixed topic "<out>/<id>/<channel>", after a 4 byte big endian sequence header,
+    // e.g. JPEG bytes correlated with a result by its frame count; the first NODE_PUBLISH_HEADER bytes of
+    // payload are left free by the producer and the header is written there, the payload never moves
+    void publish(const std::string& id, const std::string& channel, uint32_t sequence, std::vector<uint8_t> payload);
+
+    // max pending events per node before the oldest one is dropped, 0 keeps everything, < 0 is rejected
+    ma_err_t setPublishLimit(const std::string& id, int32_t limit);
+
+    // "json", "cbor" or "msgpack", responses to requests always stay JSON
+    ma_err_t setFormat(const std::string& id, const std::string& format);
+    Format getFormat(const std::string& id);
 
 protected:
     void onConnect(struct mosquitto* mosq, int rc);
     void onDisconnect(struct mosquitto* mosq, int rc);
     void onMessage(struct mosquitto* mosq, const struct mosquitto_message* msg);
+    void onPublish(struct mosquitto* mosq, int mid);
 
 private:
     static void onConnectStub(struct mosquitto* mosq, void* obj, int rc);
     static void onDisconnectStub(struct mosquitto* mosq, void* obj, int rc);
     static void onMessageStub(struct mosquitto* mosq, void* obj, const struct mosquitto_message* msg);
+    static void onPublishStub(struct mosquitto* mosq, void* obj, int mid);
+
+    void publishEntry();
+    static void publishEntryStub(void* obj);
+
+    struct Outgoing {
+        std::string id;
+        std::string key;      // drop accounting, one budget per node and side channel
+        std::string channel;  // empty for node messages
+        json msg;
+        std::vector<uint8_t> raw;
+        bool droppable;
+        Format format;
+        ma_tick_t enqueued;  // set by enqueue(), a traced result reports how long it waited here
+        std::string text;    // pre-serialized event in format, msg is unused then
+        size_t publish_at;   // trace values patched in text, 0 when none
+        size_t send_at;
+    };
+
+    void enqueue(Outgoing&& out);
+    // hands a message to the client, counted in flight until its on_publish
+    void send(const Outgoing& out, const void* data, size_t size);
+    // max pending plus in flight events of a node, under m_mutex
+    size_t limit(const std::string& id) const;
+
+    // drops the per node settings of a destroyed node, or of all of them
+    void forget(const std::string& id);
+    void forget();
+
+    friend int benchmarkExecutor(int requests);
 
     struct mosquitto* m_client;
     std::string m_client_id;
@@ -36,6 +94,29 @@ private:
     std::atomic<bool> m_connected;
     Executor m_executor;
     Mutex m_mutex;
+
+    Thread* m_sender;
+    std::atomic<bool> m_sending;
+    Semaphore m_pending_signal;
+    std::deque<Outgoing> m_pending;
+    std::unordered_map<std::string, size_t> m_pending_count;   // per drop key, queued here
+    std::unordered_map<std::string, size_t> m_inflight_count;  // per drop key, in the client's queue; never erased
+    std::deque<size_t*> m_inflight;  // counts of the messages handed to the client in order, nullptr for replies
+    std::unordered_map<std::string, size_t> m_publish_limit;
+    std::unordered_map<std::string, Format> m_format;
+    std::string m_topic;
+    std::string m_buffer;
+    std::vector<uint8_t> m_binary;
+    std::vector<std::string> m_spare;  // buffers of sent pre-serialized events, handed back to the producers
+    std::unordered_map<std::string, float> m_send_time;  // ms to serialize and hand over the last message of a node, sender thread only
 };
 
+// create, config and destroy requests through onMessage and the executor, prints the round trip of each
+// from the message arriving to its reply being queued for the sender; no broker needed
+int benchmarkExecutor(int requests);
+
+// synthetic boxes, keypoints and segments results written as JSON, CBOR and MessagePack the way the model
+// node does it, prints the payload bytes and the time per write of each next to a DOM dump for reference
+int benchmarkFormat(int iterations);
+
 }  // namespace ma::node
\ No newline at end of file
@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <filesystem>
+
+#include "source.h"
+
+namespace ma::node {
+
+static constexpr char TAG[] = "ma::node::source";
+
+#define SOURCE_DEFAULT_WIDTH  1920
+#define SOURCE_DEFAULT_HEIGHT 1080
+#define SOURCE_DEFAULT_FPS    30
+
+#define LIBCAMERA_DEFAULT_NAME "/base/axi/pcie@120000/rp1/i2c@88000/ov5647@36"
+
+FrameSource::FrameSource(int width, int height, int fps) : width_(width), height_(height), fps_(fps), next_(0) {}
+
+bool FrameSource::grab() {
+    cv2::Mat image;
+    return read(image);
+}
+
+void FrameSource::pace() {
+    if (fps_ <= 0) {
+        return;
+    }
+    const ma_tick_t interval = Tick::fromSeconds(1) / fps_;
+    const ma_tick_t now      = Tick::current();
+    if (next_ > now) {
+        Thread::sleep(next_ - now);
+    } else if (now - next_ > interval) {
+        next_ = now;  // fell behind, do not burst to catch up
+    }
+    next_ += interval;
+}
+
+FrameSource* FrameSource::create(const json& config) {
+    std::string type = "libcamera";
+    json options     = json::object();
+
+    if (config.contains("source")) {
+        if (config["source"].is_string()) {
+            type = config["source"].get<std::string>();
+        } else if (config["source"].is_object()) {
+            options = config["source"];
+            type    = options.value("type", type);
+        } else {
+            MA_THROW(Exception(MA_EINVAL, "invalid source"));
+        }
+    }
+
+    int width  = options.value("width", type == "libcamera" || type == "synthetic" ? SOURCE_DEFAULT_WIDTH : 0);
+    int height = options.value("height", type == "libcamera" || type == "synthetic" ? SOURCE_DEFAULT_HEIGHT : 0);
+    int fps    = options.value("fps", type == "file" ? 0 : SOURCE_DEFAULT_FPS);
+    bool loop  = options.value("loop", true);
+
+    if (type == "libcamera") {
+        char pipeline[512] = {0};
+        snprintf(pipeline,
+                 sizeof(pipeline),
+                 "libcamerasrc camera-name=%s ! video/x-raw,width=%d,height=%d,framerate=%d/1,format=RGBx ! videoconvert ! videoscale ! appsink",
+                 options.value("camera", std::string(LIBCAMERA_DEFAULT_NAME)).c_str(),
+                 width,
+                 height,
+                 fps);
+        // the sensor paces itself
+        return new CaptureSource(pipeline, cv2::CAP_GSTREAMER, width, height, 0, false, false);
+    } else if (type == "gstreamer") {
+        if (!options.contains("pipeline") || !options["pipeline"].is_string()) {
+            MA_THROW(Exception(MA_EINVAL, "gstreamer source requires a pipeline"));
+        }
+        return new CaptureSource(options["pipeline"].get<std::string>(), cv2::CAP_GSTREAMER, width, height, 0, false, false);
+    } else if (type == "file") {
+        if (!options.contains("path") || !options["path"].is_string()) {
+            MA_THROW(Exception(MA_EINVAL, "file source requires a path"));
+        }
+        return new CaptureSource(options["path"].get<std::string>(), cv2::CAP_ANY, width, height, fps, true, loop);
+    } else if (type == "directory") {
+        if (!options.contains("path") || !options["path"].is_string()) {
+            MA_THROW(Exception(MA_EINVAL, "directory source requires a path"));
+        }
+        return new DirectorySource(options["path"].get<std::string>(), loop, width, height, fps);
+    } else if (type == "synthetic") {
+        return new SyntheticSource(width, height, fps);
+    }
+
+    MA_THROW(Exception(MA_EINVAL, "unknown source: " + type));
+    return nullptr;
+}
+
+CaptureSource::CaptureSource(std::string uri, int api, int width, int height, int fps, bool file, bool loop)
+    : FrameSource(width, height, fps), uri_(std::move(uri)), api_(api), file_(file), loop_(loop), resize_(false) {}
+
+CaptureSource::~CaptureSource() {
+    close();
+}
+
+bool CaptureSource::open() {
+    if (!capture_.open(uri_, api_)) {
+        MA_LOGE(TAG, "open failed: %s", uri_.c_str());
+        return false;
+    }
+
+    const int width  = static_cast<int>(capture_.get(cv2::CAP_PROP_FRAME_WIDTH));
+    const int height = static_cast<int>(capture_.get(cv2::CAP_PROP_FRAME_HEIGHT));
+
+    // files are scaled to the requested size, live pipelines deliver what they negotiated
+    resize_ = file_ && width_ > 0 && height_ > 0 && (width != width_ || height != height_);
+    if (!resize_ && width > 0 && height > 0) {
+        width_  = width;
+        height_ = height;
+    }
+    if (file_ && fps_ <= 0) {
+        fps_ = static_cast<int>(capture_.get(cv2::CAP_PROP_FPS) + 0.5);
+    }
+
+    MA_LOGI(TAG, "open: %s %dx%d@%d", uri_.c_str(), width_, height_, fps_);
+    return true;
+}
+
+void CaptureSource::close() {
+    if (capture_.isOpened()) {
+        capture_.release();
+    }
+}
+
+bool CaptureSource::isOpened() const {
+    return capture_.isOpened();
+}
+
+bool CaptureSource::read(cv2::Mat& image) {
+    cv2::Mat& target = resize_ ? scratch_ : image;
+
+    if (!capture_.read(target)) {
+        if (!file_ || !loop_) {
+            return false;
+        }
+        // rewind and play the file again
+        capture_.set(cv2::CAP_PROP_POS_FRAMES, 0);
+        if (!capture_.read(target)) {
+            return false;
+        }
+    }
+    if (resize_) {
+        cv2::resize(scratch_, image, cv2::Size(width_, height_), 0, 0, cv2::INTER_LINEAR);
+    }
+
+    if (file_) {
+        pace();
+    }
+    return true;
+}
+
+bool CaptureSource::grab() {
+    if (file_) {
+        pace();
+    }
+    return capture_.grab();
+}
+
+DirectorySource::DirectorySource(std::string path, bool loop, int width, int height, int fps) : FrameSource(width, height, fps), path_(std::move(path)), loop_(loop), index_(0) {}
+
+bool DirectorySource::open() {
+    static const std::vector<std::string> extensions = {".jpg", ".jpeg", ".png", ".bmp"};
+
+    std::error_code ec;
+    files_.clear();
+    for (auto& entry : std::filesystem::directory_iterator(path_, ec)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        std::string ext = entry.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (std::find(extensions.begin(), extensions.end(), ext) != extensions.end()) {
+            files_.push_back(entry.path().string());
+        }
+    }
+    std::sort(files_.begin(), files_.end());
+    index_ = 0;
+
+    if (files_.empty()) {
+        MA_LOGE(TAG, "no images in: %s", path_.c_str());
+        return false;
+    }
+
+    // all images are scaled to the first one unless a size was given
+    if (width_ <= 0 || height_ <= 0) {
+        cv2::Mat first = cv2::imread(files_[0], cv2::IMREAD_COLOR);
+        if (first.empty()) {
+            MA_LOGE(TAG, "read failed: %s", files_[0].c_str());
+            files_.clear();
+            return false;
+        }
+        width_  = first.cols;
+        height_ = first.rows;
+    }
+
+    MA_LOGI(TAG, "open: %s %zu images %dx%d@%d", path_.c_str(), files_.size(), width_, height_, fps_);
+    return true;
+}
+
+void DirectorySource::close() {
+    files_.clear();
+}
+
+bool DirectorySource::isOpened() const {
+    return !files_.empty();
+}
+
+bool DirectorySource::read(cv2::Mat& image) {
+    if (files_.empty()) {
+        return false;
+    }
+    if (index_ >= files_.size()) {
+        if (!loop_) {
+            return false;
+        }
+        index_ = 0;
+    }
+
+    cv2::Mat decoded = cv2::imread(files_[index_++], cv2::IMREAD_COLOR);
+    if (decoded.empty()) {
+        MA_LOGW(TAG, "read failed: %s", files_[index_ - 1].c_str());
+        return false;
+    }
+    if (decoded.cols != width_ || decoded.rows != height_) {
+        cv2::resize(decoded, image, cv2::Size(width_, height_), 0, 0, cv2::INTER_LINEAR);
+    } else {
+        decoded.copyTo(image);
+    }
+
+    pace();
+    return true;
+}
+
+SyntheticSource::SyntheticSource(int width, int height, int fps) : FrameSource(width, height, fps), opened_(false), count_(0) {}
+
+bool SyntheticSource::open() {
+    if (width_ <= 0 || height_ <= 0) {
+        return false;
+    }
+
+    // horizontal color ramp, scrolled a few pixels per frame
+    pattern_.create(height_, width_, CV_8UC3);
+    for (int y = 0; y < height_; y++) {
+        uint8_t* row = pattern_.ptr<uint8_t>(y);
+        for (int x = 0; x < width_; x++) {
+            row[x * 3 + 0] = static_cast<uint8_t>(x * 255 / width_);
+            row[x * 3 + 1] = static_cast<uint8_t>(y * 255 / height_);
+            row[x * 3 + 2] = static_cast<uint8_t>(255 - x * 255 / width_);
+        }
+    }
+    count_  = 0;
+    opened_ = true;
+
+    MA_LOGI(TAG, "open: synthetic %dx%d@%d", width_, height_, fps_);
+    return true;
+}
+
+void SyntheticSource::close() {
+    opened_ = false;
+    pattern_.release();
+}
+
+bool SyntheticSource::isOpened() const {
+    return opened_;
+}
+
+bool SyntheticSource::read(cv2::Mat& image) {
+    if (!opened_) {
+        return false;
+    }
+
+    image.create(height_, width_, CV_8UC3);
+
+    const int shift = (count_ * 4) % width_;
+    pattern_.colRange(shift, width_).copyTo(image.colRange(0, width_ - shift));
+    if (shift > 0) {
+        pattern_.colRange(0, shift).copyTo(image.colRange(width_ - shift, width_));
+    }
+
+    // a solid block bouncing across the frame gives detectors and trackers something to follow
+    const int size = std::max(16, std::min(width_, height_) / 6);
+    const int span = std::max(1, width_ - size);
+    const int step = (count_ * 8) % (span * 2);
+    const int x    = step < span ? step : span * 2 - step;
+    const int y    = (height_ - size) / 2;
+    cv2::rectangle(image, cv2::Rect(x, y, size, size), cv2::Scalar(255, 255, 255), cv2::FILLED);
+    cv2::putText(image, std::to_string(count_), cv2::Point(16, 48), cv2::FONT_HERSHEY_SIMPLEX, 1.5, cv2::Scalar(0, 0, 0), 3);
+
+    count_++;
+
+    pace();
+    return true;
+}
+
+}  // namespace ma::node
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+namespace cv2 = cv;
+
+#include "node.h"
+
+namespace ma::node {
+
+// Where CameraNode gets its frames from, everything downstream only sees packed BGR images.
+// "source": "libcamera" | "gstreamer" | "file" | "directory" | "synthetic", or an object
+// {"type", "pipeline", "path", "width", "height", "fps", "loop"}.
+class FrameSource {
+public:
+    FrameSource(int width, int height, int fps);
+    virtual ~FrameSource() = default;
+
+    virtual bool open() = 0;
+    virtual void close() = 0;
+    virtual bool isOpened() const = 0;
+
+    // packed BGR, reuses the buffer of image when the geometry matches
+    virtual bool read(cv2::Mat& image) = 0;
+
+    // drop one frame, used when every consumer is still busy or none of them takes it
+    virtual bool grab();
+
+    int width() const {
+        return width_;
+    }
+    int height() const {
+        return height_;
+    }
+    int fps() const {
+        return fps_;
+    }
+
+    static FrameSource* create(const json& config);
+
+protected:
+    // block until the next frame is due, a no-op when fps is 0
+    void pace();
+
+    int width_;
+    int height_;
+    int fps_;
+    ma_tick_t next_;
+};
+
+// libcamera, custom GStreamer pipelines and video files, all through cv::VideoCapture
+class CaptureSource : public FrameSource {
+public:
+    CaptureSource(std::string uri, int api, int width, int height, int fps, bool file, bool loop);
+    ~CaptureSource() override;
+
+    bool open() override;
+    void close() override;
+    bool isOpened() const override;
+    bool read(cv2::Mat& image) override;
+    bool grab() override;
+
+private:
+    std::string uri_;
+    int api_;
+    bool file_;    // paced to fps and rewound at the end
+    bool loop_;
+    bool resize_;  // the file does not match the requested size
+    cv2::VideoCapture capture_;
+    cv2::Mat scratch_;
+};
+
+// still images of a directory in name order, played back at a fixed rate
+class DirectorySource : public FrameSource {
+public:
+    DirectorySource(std::string path, bool loop, int width, int height, int fps);
+
+    bool open() override;
+    void close() override;
+    bool isOpened() const override;
+    bool read(cv2::Mat& image) override;
+
+private:
+    std::string path_;
+    bool loop_;
+    std::vector<std::string> files_;
+    size_t index_;
+};
+
+// deterministic moving test pattern, no hardware required
+class SyntheticSource : public FrameSource {
+public:
+    SyntheticSource(int width, int height, int fps);
+
+    bool open() override;
+    void close() override;
+    bool isOpened() const override;
+    bool read(cv2::Mat& image) override;
+
+private:
+    bool opened_;
+    uint32_t count_;
+    cv2::Mat pattern_;
+};
+
+}  // namespace ma::node
@@ -0,0 +1,529 @@
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <stdio.h>
+
+#include "tracker.h"
+
+namespace ma::node {
+
+// alpha-beta filter gains: share of the residual taken into the position and into the velocity
+#define TRACKER_ALPHA 0.6f
+#define TRACKER_BETA  0.2f
+
+// second and third association rounds, same thresholds as ByteTrack
+#define TRACKER_LOW_SCORE     0.1f
+#define TRACKER_LOW_THRESH    0.5f
+#define TRACKER_UNCONF_THRESH 0.7f
+
+// square min cost assignment with dual potentials and shortest augmenting paths (Jonker-Volgenant / Hungarian),
+// O(n^3) but only ever run on one connected component of the gated graph
+void Tracker::solve(int n) {
+    const float inf              = std::numeric_limits<float>::max();
+    const float* cost            = matrix_.data();
+    std::vector<float>& u        = u_;
+    std::vector<float>& v        = v_;
+    std::vector<float>& minv     = minv_;
+    std::vector<int32_t>& p      = p_;
+    std::vector<int32_t>& way    = way_;
+    std::vector<uint8_t>& used   = used_;
+    std::vector<int32_t>& rowsol = rowsol_;
+    u.assign(n + 1, 0.0f);
+    v.assign(n + 1, 0.0f);
+    minv.resize(n + 1);
+    p.assign(n + 1, 0);
+    way.assign(n + 1, 0);
+    used.resize(n + 1);
+
+    for (int i = 1; i <= n; i++) {
+        p[0]   = i;
+        int j0 = 0;
+        std::fill(minv.begin(), minv.end(), inf);
+        std::fill(used.begin(), used.end(), 0);
+        do {
+            used[j0]    = 1;
+            int i0      = p[j0];
+            int j1      = 0;
+            float delta = inf;
+            for (int j = 1; j <= n; j++) {
+                if (used[j]) {
+                    continue;
+                }
+                float cur = cost[(i0 - 1) * n + (j - 1)] - u[i0] - v[j];
+                if (cur < minv[j]) {
+                    minv[j] = cur;
+                    way[j]  = j0;
+                }
+                if (minv[j] < delta) {
+                    delta = minv[j];
+                    j1    = j;
+                }
+            }
+            for (int j = 0; j <= n; j++) {
+                if (used[j]) {
+                    u[p[j]] += delta;
+                    v[j] -= delta;
+                } else {
+                    minv[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (p[j0] != 0);
+        do {
+            int j1 = way[j0];
+            p[j0]  = p[j1];
+            j0     = j1;
+        } while (j0 != 0);
+    }
+
+    rowsol.assign(n, -1);
+    for (int j = 1; j <= n; j++) {
+        if (p[j] != 0) {
+            rowsol[p[j] - 1] = j - 1;
+        }
+    }
+}
+
+static int32_t find(std::vector<int32_t>& parent, int32_t x) {
+    while (parent[x] != x) {
+        parent[x] = parent[parent[x]];
+        x         = parent[x];
+    }
+    return x;
+}
+
+Tracker::Tracker(int32_t max_lost, float track_thresh, float high_thresh, float match_thresh)
+    : max_lost_(max_lost), track_thresh_(track_thresh), high_thresh_(high_thresh), match_thresh_(match_thresh), next_id_(1), first_(true), boxes_(nullptr) {}
+
+void Tracker::clear() {
+    ids_.clear();
+    state_.clear();
+    lost_.clear();
+    cx_.clear();
+    cy_.clear();
+    w_.clear();
+    h_.clear();
+    vx_.clear();
+    vy_.clear();
+    vw_.clear();
+    vh_.clear();
+    next_id_ = 1;
+    first_   = true;
+}
+
+void Tracker::predict() {
+    const size_t n = ids_.size();
+    for (size_t i = 0; i < n; i++) {
+        cx_[i] += vx_[i];
+        cy_[i] += vy_[i];
+        w_[i] = std::max(w_[i] + vw_[i], 1e-4f);
+        h_[i] = std::max(h_[i] + vh_[i], 1e-4f);
+    }
+}
+
+void Tracker::correct(int32_t track, const ma_bbox_t& box) {
+    float rx = box.x - cx_[track];
+    float ry = box.y - cy_[track];
+    float rw = box.w - w_[track];
+    float rh = box.h - h_[track];
+    cx_[track] += TRACKER_ALPHA * rx;
+    cy_[track] += TRACKER_ALPHA * ry;
+    w_[track] += TRACKER_ALPHA * rw;
+    h_[track] += TRACKER_ALPHA * rh;
+    vx_[track] += TRACKER_BETA * rx;
+    vy_[track] += TRACKER_BETA * ry;
+    vw_[track] += TRACKER_BETA * rw;
+    vh_[track] += TRACKER_BETA * rh;
+    state_[track] = TRACKED;
+    lost_[track]  = 0;
+}
+
+void Tracker::spawn(const ma_bbox_t& box) {
+    ids_.push_back(next_id_++);
+    state_.push_back(first_ ? TRACKED : NEW);
+    lost_.push_back(0);
+    cx_.push_back(box.x);
+    cy_.push_back(box.y);
+    w_.push_back(box.w);
+    h_.push_back(box.h);
+    vx_.push_back(0.0f);
+    vy_.push_back(0.0f);
+    vw_.push_back(0.0f);
+    vh_.push_back(0.0f);
+}
+
+void Tracker::remove(int32_t track) {
+    // swap with the last one, the order of the tracks carries no meaning
+    const size_t last = ids_.size() - 1;
+    ids_[track]       = ids_[last];
+    state_[track]     = state_[last];
+    lost_[track]      = lost_[last];
+    cx_[track]        = cx_[last];
+    cy_[track]        = cy_[last];
+    w_[track]         = w_[last];
+    h_[track]         = h_[last];
+    vx_[track]        = vx_[last];
+    vy_[track]        = vy_[last];
+    vw_[track]        = vw_[last];
+    vh_[track]        = vh_[last];
+    ids_.pop_back();
+    state_.pop_back();
+    lost_.pop_back();
+    cx_.pop_back();
+    cy_.pop_back();
+    w_.pop_back();
+    h_.pop_back();
+    vx_.pop_back();
+    vy_.pop_back();
+    vw_.pop_back();
+    vh_.pop_back();
+}
+
+void Tracker::associate(const std::vector<int32_t>& tracks,
+                        const std::vector<int32_t>& dets,
+                        float thresh,
+                        std::vector<std::pair<int32_t, int32_t>>& matches,
+                        std::vector<int32_t>& unmatched_tracks,
+                        std::vector<int32_t>& unmatched_dets) {
+    matches.clear();
+    unmatched_tracks.clear();
+    unmatched_dets.clear();
+    // sized by the counts up front, a path a steady scene takes for the first time does not allocate either
+    matches.reserve(std::min(tracks.size(), dets.size()));
+    unmatched_tracks.reserve(tracks.size());
+    unmatched_dets.reserve(dets.size());
+    if (tracks.empty() || dets.empty()) {
+        unmatched_tracks = tracks;
+        unmatched_dets   = dets;
+        return;
+    }
+
+    const std::vector<ma_bbox_t>& boxes = *boxes_;
+    const size_t nt                     = tracks.size();
+    const size_t nd                     = dets.size();
+
+    // detections sorted by left edge in contiguous arrays
+    order_.resize(nd);
+    std::iota(order_.begin(), order_.end(), 0);
+    std::sort(order_.begin(), order_.end(), [&](int32_t a, int32_t b) {
+        return boxes[dets[a]].x - boxes[dets[a]].w / 2 < boxes[dets[b]].x - boxes[dets[b]].w / 2;
+    });
+    dx1_.resize(nd);
+    dy1_.resize(nd);
+    dx2_.resize(nd);
+    dy2_.resize(nd);
+    darea_.resize(nd);
+    float max_width = 0.0f;
+    for (size_t k = 0; k < nd; k++) {
+        const ma_bbox_t& box = boxes[dets[order_[k]]];
+        dx1_[k]              = box.x - box.w / 2;
+        dy1_[k]              = box.y - box.h / 2;
+        dx2_[k]              = box.x + box.w / 2;
+        dy2_[k]              = box.y + box.h / 2;
+        darea_[k]            = box.w * box.h;
+        max_width            = std::max(max_width, box.w);
+    }
+
+    // gated IoU: a detection starting right of the track, or ending left of it however wide it is, cannot
+    // overlap it; only the window of left edges in between is visited, the loop body is branch free
+    const float min_iou = 1.0f - thresh;
+    iou_.resize(nd);
+    edges_.clear();
+    for (size_t i = 0; i < nt; i++) {
+        const int32_t t    = tracks[i];
+        const float tx1    = cx_[t] - w_[t] / 2;
+        const float ty1    = cy_[t] - h_[t] / 2;
+        const float tx2    = cx_[t] + w_[t] / 2;
+        const float ty2    = cy_[t] + h_[t] / 2;
+        const float ta     = w_[t] * h_[t];
+        const size_t begin = std::lower_bound(dx1_.begin(), dx1_.end(), tx1 - max_width) - dx1_.begin();
+        const size_t end   = std::lower_bound(dx1_.begin() + begin, dx1_.end(), tx2) - dx1_.begin();
+
+        const float* x1 = dx1_.data();
+        const float* y1 = dy1_.data();
+        const float* x2 = dx2_.data();
+        const float* y2 = dy2_.data();
+        const float* da = darea_.data();
+        float* iou      = iou_.data();
+        for (size_t k = begin; k < end; k++) {
+            float iw    = std::max(0.0f, std::min(tx2, x2[k]) - std::max(tx1, x1[k]));
+            float ih    = std::max(0.0f, std::min(ty2, y2[k]) - std::max(ty1, y1[k]));
+            float inter = iw * ih;
+            iou[k]      = inter / (ta + da[k] - inter + 1e-9f);
+        }
+        for (size_t k = begin; k < end; k++) {
+            if (iou[k] > 0.0f && iou[k] >= min_iou) {
+                edges_.push_back({static_cast<int32_t>(i), static_cast<int32_t>(k), 1.0f - iou[k]});
+            }
+        }
+    }
+
+    // connected components of the sparse graph, tracks first then detections
+    parent_.resize(nt + nd);
+    std::iota(parent_.begin(), parent_.end(), 0);
+    for (auto& edge : edges_) {
+        int32_t a = find(parent_, edge.track);
+        int32_t b = find(parent_, nt + edge.det);
+        if (a != b) {
+            parent_[a] = b;
+        }
+    }
+    std::sort(edges_.begin(), edges_.end(), [&](const Edge& a, const Edge& b) { return find(parent_, a.track) < find(parent_, b.track); });
+
+    std::vector<uint8_t>& track_done = track_done_;
+    std::vector<uint8_t>& det_done   = det_done_;
+    std::vector<int32_t>& rows       = rows_;
+    std::vector<int32_t>& cols       = cols_;
+    track_done.assign(nt, 0);
+    det_done.assign(nd, 0);
+    for (size_t begin = 0; begin < edges_.size();) {
+        const int32_t root = find(parent_, edges_[begin].track);
+        size_t end         = begin;
+        while (end < edges_.size() && find(parent_, edges_[end].track) == root) {
+            end++;
+        }
+
+        if (end - begin == 1) {
+            // the common case once the scene is gated: one track, one detection
+            matches.emplace_back(tracks[edges_[begin].track], dets[order_[edges_[begin].det]]);
+            track_done[edges_[begin].track] = 1;
+            det_done[edges_[begin].det]     = 1;
+            begin                           = end;
+            continue;
+        }
+
+        rows.clear();
+        cols.clear();
+        for (size_t e = begin; e < end; e++) {
+            if (std::find(rows.begin(), rows.end(), edges_[e].track) == rows.end()) {
+                rows.push_back(edges_[e].track);
+            }
+            if (std::find(cols.begin(), cols.end(), edges_[e].det) == cols.end()) {
+                cols.push_back(edges_[e].det);
+            }
+        }
+
+        // extended like lapjv(extend_cost, cost_limit): leaving a row and a column unmatched costs thresh,
+        // so no pair above thresh is ever worth taking, missing pairs cost more than that
+        const int r = rows.size();
+        const int c = cols.size();
+        const int n = r + c;
+        matrix_.assign(n * n, thresh / 2);
+        for (int i = r; i < n; i++) {
+            std::fill(matrix_.begin() + i * n + c, matrix_.begin() + (i + 1) * n, 0.0f);
+        }
+        for (int i = 0; i < r; i++) {
+            std::fill(matrix_.begin() + i * n, matrix_.begin() + i * n + c, thresh + 1.0f);
+        }
+        for (size_t e = begin; e < end; e++) {
+            int i              = std::find(rows.begin(), rows.end(), edges_[e].track) - rows.begin();
+            int j              = std::find(cols.begin(), cols.end(), edges_[e].det) - cols.begin();
+            matrix_[i * n + j] = edges_[e].cost;
+        }
+
+        solve(n);
+        for (int i = 0; i < r; i++) {
+            int j = rowsol_[i];
+            if (j >= 0 && j < c && matrix_[i * n + j] <= thresh) {
+                matches.emplace_back(tracks[rows[i]], dets[order_[cols[j]]]);
+                track_done[rows[i]] = 1;
+                det_done[cols[j]]   = 1;
+            }
+        }
+        begin = end;
+    }
+
+    for (size_t i = 0; i < nt; i++) {
+        if (!track_done[i]) {
+            unmatched_tracks.push_back(tracks[i]);
+        }
+    }
+    for (size_t k = 0; k < nd; k++) {
+        if (!det_done[k]) {
+            unmatched_dets.push_back(dets[order_[k]]);
+        }
+    }
+}
+
+std::vector<int> Tracker::inplace_update(std::vector<ma_bbox_t>& boxes) {
+    std::vector<int> result;
+    inplace_update(boxes, result);
+    return result;
+}
+
+void Tracker::inplace_update(std::vector<ma_bbox_t>& boxes, std::vector<int>& result) {
+    result.assign(boxes.size(), -1);
+    boxes_ = &boxes;
+
+    predict();
+
+    // all scratch lives in members, a steady scene does not allocate
+    std::vector<int32_t>& high             = high_;
+    std::vector<int32_t>& low              = low_;
+    std::vector<int32_t>& confirmed        = confirmed_;
+    std::vector<int32_t>& unconfirmed      = unconfirmed_;
+    std::vector<int32_t>& unmatched_tracks = unmatched_tracks_;
+    std::vector<int32_t>& unmatched_high   = unmatched_high_;
+    std::vector<int32_t>& unmatched_low    = unmatched_low_;
+    std::vector<int32_t>& left             = left_;
+    std::vector<int32_t>& tracked          = tracked_;
+    std::vector<int32_t>& doomed           = doomed_;
+    auto& matches                          = matches_;
+    high.clear();
+    low.clear();
+    confirmed.clear();
+    unconfirmed.clear();
+    tracked.clear();
+    doomed.clear();
+    high.reserve(boxes.size());
+    low.reserve(boxes.size());
+    confirmed.reserve(ids_.size());
+    unconfirmed.reserve(ids_.size());
+    tracked.reserve(ids_.size());
+    doomed.reserve(ids_.size());
+    for (size_t j = 0; j < boxes.size(); j++) {
+        if (boxes[j].score >= track_thresh_) {
+            high.push_back(j);
+        } else if (boxes[j].score > TRACKER_LOW_SCORE) {
+            low.push_back(j);
+        }
+    }
+
+    for (size_t t = 0; t < ids_.size(); t++) {
+        (state_[t] == NEW ? unconfirmed : confirmed).push_back(t);
+    }
+
+    // 1. confident detections against tracked and lost tracks
+    associate(confirmed, high, match_thresh_, matches, unmatched_tracks, unmatched_high);
+    for (auto& match : matches) {
+        correct(match.first, boxes[match.second]);
+        result[match.second] = ids_[match.first];
+    }
+
+    // 2. weak detections only keep tracks alive that were tracked up to now
+    for (auto t : unmatched_tracks) {
+        if (state_[t] == TRACKED) {
+            tracked.push_back(t);
+        }
+    }
+    associate(tracked, low, TRACKER_LOW_THRESH, matches, unmatched_tracks, unmatched_low);
+    for (auto& match : matches) {
+        correct(match.first, boxes[match.second]);
+        result[match.second] = ids_[match.first];
+    }
+    for (auto t : unmatched_tracks) {
+        state_[t] = LOST;
+    }
+
+    // 3. tracks seen once get one more chance against the remaining confident detections
+    associate(unconfirmed, unmatched_high, TRACKER_UNCONF_THRESH, matches, unmatched_tracks, left);
+    for (auto& match : matches) {
+        correct(match.first, boxes[match.second]);
+        result[match.second] = ids_[match.first];
+    }
+    doomed.insert(doomed.end(), unmatched_tracks.begin(), unmatched_tracks.end());
+
+    // 4. age the lost tracks
+    for (size_t t = 0; t < ids_.size(); t++) {
+        if (state_[t] == LOST && ++lost_[t] > max_lost_) {
+            doomed.push_back(t);
+        }
+    }
+    std::sort(doomed.begin(), doomed.end(), std::greater<int32_t>());
+    doomed.erase(std::unique(doomed.begin(), doomed.end()), doomed.end());
+    for (auto t : doomed) {
+        remove(t);
+    }
+
+    // 5. what is left and confident enough starts a track
+    for (auto j : left) {
+        if (boxes[j].score >= high_thresh_) {
+            spawn(boxes[j]);
+            result[j] = ids_.back();
+        }
+    }
+    first_ = false;
+    boxes_ = nullptr;
+}
+
+int benchmarkTracker(int frames) {
+    const int sizes[] = {10, 50, 100, 200, 500};
+
+    struct Object {
+        float x;
+        float y;
+        float vx;
+        float vy;
+        float w;
+        float h;
+    };
+
+    printf("%8s %10s %10s %10s %10s %8s\n", "objects", "mean(ms)", "p50(ms)", "p99(ms)", "max(ms)", "tracks");
+    for (int n : sizes) {
+        std::mt19937 rng(n);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::normal_distribution<float> noise(0.0f, 0.002f);
+
+        // constant velocity walkers bouncing off the borders, 5% missed detections and some clutter
+        std::vector<Object> objects(n);
+        for (auto& object : objects) {
+            object.x  = unit(rng);
+            object.y  = unit(rng);
+            object.vx = (unit(rng) - 0.5f) * 0.008f;
+            object.vy = (unit(rng) - 0.5f) * 0.008f;
+            object.w  = 0.01f + unit(rng) * 0.03f;
+            object.h  = 0.02f + unit(rng) * 0.05f;
+        }
+
+        Tracker tracker;
+        std::vector<ma_bbox_t> boxes;
+        std::vector<double> times;
+        times.reserve(frames);
+        for (int f = 0; f < std::max(frames, 1); f++) {
+            boxes.clear();
+            for (auto& object : objects) {
+                object.x += object.vx;
+                object.y += object.vy;
+                if (object.x < 0.0f || object.x > 1.0f) {
+                    object.vx = -object.vx;
+                }
+                if (object.y < 0.0f || object.y > 1.0f) {
+                    object.vy = -object.vy;
+                }
+                if (unit(rng) < 0.05f) {
+                    continue;
+                }
+                ma_bbox_t box = {};
+                box.x         = object.x + noise(rng);
+                box.y         = object.y + noise(rng);
+                box.w         = object.w;
+                box.h         = object.h;
+                box.score     = 0.3f + unit(rng) * 0.7f;
+                boxes.push_back(box);
+            }
+            for (int i = 0; i < n / 20; i++) {
+                ma_bbox_t box = {};
+                box.x         = unit(rng);
+                box.y         = unit(rng);
+                box.w         = 0.02f;
+                box.h         = 0.04f;
+                box.score     = 0.1f + unit(rng) * 0.4f;
+                boxes.push_back(box);
+            }
+
+            auto start = std::chrono::steady_clock::now();
+            tracker.inplace_update(boxes);
+            times.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+        }
+
+        std::sort(times.begin(), times.end());
+        double mean = std::accumulate(times.begin(), times.end(), 0.0) / times.size();
+        printf("%8d %10.3f %10.3f %10.3f %10.3f %8zu\n", n, mean, times[times.size() / 2], times[std::min(times.size() - 1, times.size() * 99 / 100)], times.back(), tracker.size());
+    }
+
+    return 0;
+}
+
+}  // namespace ma::node
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "core/ma_core.h"
+
+namespace ma::node {
+
+// ByteTrack style multi object tracker sized for crowded scenes.
+// Tracks live in flat arrays (one per field), the IoU between predicted tracks and detections is
+// computed over contiguous arrays, pairs that cannot overlap are never visited (detections sorted by
+// left edge, each track only scans the window that can reach it), and the assignment is solved per connected component of the remaining sparse graph with
+// a shortest augmenting path (Jonker-Volgenant) solver, so its cost follows the clusters, not N x M.
+// Motion is a constant velocity alpha-beta filter per box parameter.
+class Tracker {
+public:
+    Tracker(int32_t max_lost = 30, float track_thresh = 0.5f, float high_thresh = 0.6f, float match_thresh = 0.8f);
+    ~Tracker() = default;
+
+    // boxes: 0..1 centre based detections of this frame, returns the track id of every box, -1 when it has none
+    std::vector<int> inplace_update(std::vector<ma_bbox_t>& boxes);
+    // same, into a vector the caller keeps between frames
+    void inplace_update(std::vector<ma_bbox_t>& boxes, std::vector<int>& ids);
+    void clear();
+
+    size_t size() const {
+        return ids_.size();
+    }
+
+private:
+    enum State : uint8_t {
+        NEW,  // seen once, dropped when not matched on the next frame
+        TRACKED,
+        LOST,
+    };
+
+    struct Edge {
+        int32_t track;
+        int32_t det;
+        float cost;
+    };
+
+    // matches tracks against detections (indices into the track arrays and the frame), cost = 1 - IoU <= thresh
+    void associate(const std::vector<int32_t>& tracks,
+                   const std::vector<int32_t>& dets,
+                   float thresh,
+                   std::vector<std::pair<int32_t, int32_t>>& matches,
+                   std::vector<int32_t>& unmatched_tracks,
+                   std::vector<int32_t>& unmatched_dets);
+
+    // min cost assignment of the square matrix_, rows to columns in rowsol_
+    void solve(int n);
+
+    void predict();
+    void correct(int32_t track, const ma_bbox_t& box);
+    void spawn(const ma_bbox_t& box);
+    void remove(int32_t track);
+
+    int32_t max_lost_;
+    float track_thresh_;
+    float high_thresh_;
+    float match_thresh_;
+    int32_t next_id_;
+    bool first_;
+
+    // one entry per track
+    std::vector<int32_t> ids_;
+    std::vector<uint8_t> state_;
+    std::vector<int32_t> lost_;  // frames since the last match
+    std::vector<float> cx_;
+    std::vector<float> cy_;
+    std::vector<float> w_;
+    std::vector<float> h_;
+    std::vector<float> vx_;
+    std::vector<float> vy_;
+    std::vector<float> vw_;
+    std::vector<float> vh_;
+
+    // scratch, reused between updates
+    const std::vector<ma_bbox_t>* boxes_;
+    std::vector<int32_t> order_;
+    std::vector<float> dx1_;
+    std::vector<float> dy1_;
+    std::vector<float> dx2_;
+    std::vector<float> dy2_;
+    std::vector<float> darea_;
+    std::vector<float> iou_;
+    std::vector<Edge> edges_;
+    std::vector<int32_t> parent_;
+    std::vector<float> matrix_;
+    std::vector<uint8_t> track_done_;
+    std::vector<uint8_t> det_done_;
+    std::vector<int32_t> rows_;
+    std::vector<int32_t> cols_;
+    std::vector<float> u_;  // solver potentials and paths
+    std::vector<float> v_;
+    std::vector<float> minv_;
+    std::vector<int32_t> p_;
+    std::vector<int32_t> way_;
+    std::vector<uint8_t> used_;
+    std::vector<int32_t> rowsol_;
+    std::vector<int32_t> high_;  // update rounds
+    std::vector<int32_t> low_;
+    std::vector<int32_t> confirmed_;
+    std::vector<int32_t> unconfirmed_;
+    std::vector<int32_t> tracked_;
+    std::vector<int32_t> unmatched_tracks_;
+    std::vector<int32_t> unmatched_high_;
+    std::vector<int32_t> unmatched_low_;
+    std::vector<int32_t> left_;
+    std::vector<int32_t> doomed_;
+    std::vector<std::pair<int32_t, int32_t>> matches_;
+};
+
+// synthetic trajectories of 10..500 objects through the tracker, prints the time per update
+int benchmarkTracker(int frames);
+
+}  // namespace ma::node
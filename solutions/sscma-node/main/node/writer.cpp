@@ -0,0 +1,395 @@
+#include <cinttypes>
+#include <cmath>
+#include <cstring>
+#include <stdio.h>
+
+#include "writer.h"
+
+namespace ma::node {
+
+// type byte followed by bytes of value, big endian
+static void put(std::string& out, uint8_t type, uint64_t value, int bytes) {
+    out.push_back(static_cast<char>(type));
+    for (int i = bytes - 1; i >= 0; i--) {
+        out.push_back(static_cast<char>(value >> (i * 8)));
+    }
+}
+
+// major type and argument of a CBOR item, the argument as short as it fits
+static void cbor(std::string& out, uint8_t major, uint64_t value) {
+    major <<= 5;
+    if (value < 24) {
+        out.push_back(static_cast<char>(major | value));
+    } else if (value <= 0xff) {
+        put(out, major | 24, value, 1);
+    } else if (value <= 0xffff) {
+        put(out, major | 25, value, 2);
+    } else if (value <= 0xffffffff) {
+        put(out, major | 26, value, 4);
+    } else {
+        put(out, major | 27, value, 8);
+    }
+}
+
+// what goes in front of the bytes of a string in the binary formats
+static void head(std::string& out, JsonWriter::Format format, size_t length) {
+    if (format == JsonWriter::Format::CBOR) {
+        cbor(out, 3, length);
+    } else if (length < 32) {
+        out.push_back(static_cast<char>(0xa0 | length));
+    } else if (length <= 0xff) {
+        put(out, 0xd9, length, 1);
+    } else if (length <= 0xffff) {
+        put(out, 0xda, length, 2);
+    } else {
+        put(out, 0xdb, length, 4);
+    }
+}
+
+static uint32_t bits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+JsonWriter::JsonWriter(std::string& out, Format format) : out_(out), format_(format), depth_(0), keyed_(false) {
+    count_[0]  = 0;
+    header_[0] = 0;
+}
+
+void JsonWriter::separate() {
+    if (keyed_) {
+        keyed_ = false;
+        return;
+    }
+    if (format_ == Format::JSON && count_[depth_] > 0) {
+        out_.push_back(',');
+    }
+    count_[depth_]++;
+}
+
+void JsonWriter::append(const char* text, int length) {
+    if (length > 0) {
+        out_.append(text, length);
+    }
+}
+
+void JsonWriter::quote(const char* value, size_t length) {
+    static const char hex[] = "0123456789abcdef";
+
+    out_.push_back('"');
+    size_t begin = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = value[i];
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out_.append(value + begin, i - begin);
+        begin = i + 1;
+        if (c == '"' || c == '\\') {
+            out_.push_back('\\');
+            out_.push_back(c);
+        } else {
+            char escaped[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+            out_.append(escaped, sizeof(escaped));
+        }
+    }
+    out_.append(value + begin, length - begin);
+    out_.push_back('"');
+}
+
+void JsonWriter::string(const char* value, size_t length) {
+    if (format_ == Format::JSON) {
+        quote(value, length);
+    } else {
+        head(out_, format_, length);
+        out_.append(value, length);
+    }
+}
+
+// negative values come as -1 - value, what CBOR encodes, the two's complement of it for MessagePack
+void JsonWriter::integer(bool negative, uint64_t value) {
+    if (format_ == Format::JSON) {
+        // digits from the back, snprintf would cost more than everything else here together
+        char text[24];
+        char* end          = text + sizeof(text);
+        char* begin        = end;
+        uint64_t magnitude = negative ? value + 1 : value;
+        do {
+            *--begin = static_cast<char>('0' + magnitude % 10);
+            magnitude /= 10;
+        } while (magnitude > 0);
+        if (negative) {
+            *--begin = '-';
+        }
+        out_.append(begin, end - begin);
+    } else if (format_ == Format::CBOR) {
+        cbor(out_, negative ? 1 : 0, value);
+    } else if (!negative) {
+        if (value < 0x80) {
+            out_.push_back(static_cast<char>(value));
+        } else if (value <= 0xff) {
+            put(out_, 0xcc, value, 1);
+        } else if (value <= 0xffff) {
+            put(out_, 0xcd, value, 2);
+        } else if (value <= 0xffffffff) {
+            put(out_, 0xce, value, 4);
+        } else {
+            put(out_, 0xcf, value, 8);
+        }
+    } else {
+        if (value < 32) {
+            out_.push_back(static_cast<char>(~value));
+        } else if (value < 0x80) {
+            put(out_, 0xd0, ~value, 1);
+        } else if (value < 0x8000) {
+            put(out_, 0xd1, ~value, 2);
+        } else if (value < 0x80000000) {
+            put(out_, 0xd2, ~value, 4);
+        } else {
+            put(out_, 0xd3, ~value, 8);
+        }
+    }
+}
+
+void JsonWriter::begin(bool object) {
+    separate();
+    MA_ASSERT(depth_ + 1 < JSON_WRITER_DEPTH);
+    depth_++;
+    count_[depth_] = 0;
+    if (format_ == Format::JSON) {
+        out_.push_back(object ? '{' : '[');
+    } else if (format_ == Format::CBOR) {
+        out_.push_back(static_cast<char>(object ? 0xbf : 0x9f));
+    } else {
+        header_[depth_] = out_.size() + 1;
+        put(out_, object ? 0xde : 0xdc, 0, 2);
+    }
+}
+
+void JsonWriter::end(bool object) {
+    if (format_ == Format::JSON) {
+        out_.push_back(object ? '}' : ']');
+    } else if (format_ == Format::CBOR) {
+        out_.push_back(static_cast<char>(0xff));
+    } else {
+        MA_ASSERT(count_[depth_] <= 0xffff);
+        out_[header_[depth_]]     = static_cast<char>(count_[depth_] >> 8);
+        out_[header_[depth_] + 1] = static_cast<char>(count_[depth_]);
+    }
+    depth_--;
+}
+
+JsonWriter& JsonWriter::beginObject() {
+    begin(true);
+    return *this;
+}
+
+JsonWriter& JsonWriter::endObject() {
+    end(true);
+    return *this;
+}
+
+JsonWriter& JsonWriter::beginArray() {
+    begin(false);
+    return *this;
+}
+
+JsonWriter& JsonWriter::endArray() {
+    end(false);
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(const char* name) {
+    separate();
+    string(name, strlen(name));
+    if (format_ == Format::JSON) {
+        out_.push_back(':');
+    }
+    keyed_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool value) {
+    separate();
+    if (format_ == Format::CBOR) {
+        out_.push_back(static_cast<char>(value ? 0xf5 : 0xf4));
+    } else if (format_ == Format::MSGPACK) {
+        out_.push_back(static_cast<char>(value ? 0xc3 : 0xc2));
+    } else if (value) {
+        out_.append("true", 4);
+    } else {
+        out_.append("false", 5);
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(int32_t value) {
+    return this->value(static_cast<int64_t>(value));
+}
+
+JsonWriter& JsonWriter::value(uint32_t value) {
+    return this->value(static_cast<uint64_t>(value));
+}
+
+JsonWriter& JsonWriter::value(int64_t value) {
+    separate();
+    if (value < 0) {
+        integer(true, static_cast<uint64_t>(-(value + 1)));
+    } else {
+        integer(false, static_cast<uint64_t>(value));
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(uint64_t value) {
+    separate();
+    integer(false, value);
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(float value) {
+    if (!std::isfinite(value)) {
+        return null();
+    }
+    separate();
+    if (format_ == Format::JSON) {
+        char text[32];
+        append(text, snprintf(text, sizeof(text), "%.7g", value));
+    } else {
+        put(out_, format_ == Format::CBOR ? 0xfa : 0xca, bits(value), 4);
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(double value) {
+    if (!std::isfinite(value)) {
+        return null();
+    }
+    separate();
+    if (format_ == Format::JSON) {
+        char text[32];
+        append(text, snprintf(text, sizeof(text), "%.15g", value));
+    } else {
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        put(out_, format_ == Format::CBOR ? 0xfb : 0xcb, bits, 8);
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const char* value) {
+    separate();
+    string(value, strlen(value));
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const std::string& value) {
+    separate();
+    string(value.data(), value.size());
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const json& value) {
+    separate();
+    if (format_ == Format::CBOR) {
+        json::to_cbor(value, out_);
+    } else if (format_ == Format::MSGPACK) {
+        json::to_msgpack(value, out_);
+    } else {
+        out_.append(value.dump());
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::null() {
+    separate();
+    if (format_ == Format::CBOR) {
+        out_.push_back(static_cast<char>(0xf6));
+    } else if (format_ == Format::MSGPACK) {
+        out_.push_back(static_cast<char>(0xc0));
+    } else {
+        out_.append("null", 4);
+    }
+    return *this;
+}
+
+// JSON pads with leading blanks, the binary formats always take the 32 bit encoding
+JsonWriter& JsonWriter::fixed(uint32_t value, size_t& at) {
+    separate();
+    at = out_.size();
+    if (format_ == Format::JSON) {
+        out_.append(10, ' ');
+    } else {
+        put(out_, format_ == Format::CBOR ? 0x1a : 0xce, 0, 4);
+    }
+    patch(out_, format_, at, value);
+    return *this;
+}
+
+JsonWriter& JsonWriter::fixed(float value, size_t& at) {
+    separate();
+    at = out_.size();
+    if (format_ == Format::JSON) {
+        out_.append(16, ' ');
+    } else {
+        put(out_, format_ == Format::CBOR ? 0xfa : 0xca, 0, 4);
+    }
+    patch(out_, format_, at, value);
+    return *this;
+}
+
+void JsonWriter::patch(std::string& out, Format format, size_t at, uint32_t value) {
+    if (format == Format::JSON) {
+        char text[16];
+        snprintf(text, sizeof(text), "%10" PRIu32, value);
+        out.replace(at, 10, text, 10);
+    } else {
+        for (int i = 0; i < 4; i++) {
+            out[at + 1 + i] = static_cast<char>(value >> ((3 - i) * 8));
+        }
+    }
+}
+
+void JsonWriter::patch(std::string& out, Format format, size_t at, float value) {
+    if (format == Format::JSON) {
+        char text[32];
+        if (std::isfinite(value)) {
+            snprintf(text, sizeof(text), "%16.7g", value);
+        } else {
+            snprintf(text, sizeof(text), "%16s", "null");
+        }
+        out.replace(at, 16, text, 16);
+    } else {
+        patch(out, format, at, bits(value));
+    }
+}
+
+JsonWriter& JsonWriter::empty(size_t& at) {
+    separate();
+    if (format_ == Format::JSON) {
+        out_.append("\"\"", 2);
+        at = out_.size() - 1;
+    } else {
+        at = out_.size();
+        head(out_, format_, 0);
+    }
+    return *this;
+}
+
+// the binary formats replace the one byte head of the empty string, all of it in one move of the tail
+size_t JsonWriter::fill(std::string& out, Format format, size_t at, const std::string& text) {
+    std::string prefix;  // at most 5 bytes, no allocation
+    size_t replaced = 0;
+    if (format != Format::JSON) {
+        head(prefix, format, text.size());
+        replaced = 1;
+    }
+    size_t grown = prefix.size() + text.size() - replaced;
+    out.insert(at + replaced, grown, '\0');
+    memcpy(&out[at], prefix.data(), prefix.size());
+    memcpy(&out[at + prefix.size()], text.data(), text.size());
+    return grown;
+}
+
+}  // namespace ma::node
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "node.h"
+
+namespace ma::node {
+
+#define JSON_WRITER_DEPTH 16
+
+// JSON, CBOR or MessagePack straight into a caller owned buffer, no DOM in between. Commas, nesting and
+// container sizes are tracked here, the caller only says what comes next. Nothing is allocated but the
+// buffer itself, and that only until it has grown to the largest message, so a buffer kept between
+// messages makes writing allocation free. CBOR containers are indefinite length, MessagePack ones take
+// a 16 bit size filled in when they end, so at most 65535 entries each.
+class JsonWriter {
+public:
+    enum class Format {
+        JSON,
+        CBOR,
+        MSGPACK,
+    };
+
+    // appends to out
+    explicit JsonWriter(std::string& out, Format format = Format::JSON);
+    ~JsonWriter() = default;
+
+    JsonWriter& beginObject();
+    JsonWriter& endObject();
+    JsonWriter& beginArray();
+    JsonWriter& endArray();
+    JsonWriter& key(const char* name);
+
+    JsonWriter& value(bool value);
+    JsonWriter& value(int32_t value);
+    JsonWriter& value(uint32_t value);
+    JsonWriter& value(int64_t value);
+    JsonWriter& value(uint64_t value);
+    JsonWriter& value(float value);   // 7 significant digits, null when not finite
+    JsonWriter& value(double value);  // 15 significant digits, null when not finite
+    JsonWriter& value(const char* value);
+    JsonWriter& value(const std::string& value);
+    // a DOM subtree as is, for the parts that only exist as json; allocates
+    JsonWriter& value(const json& value);
+    JsonWriter& null();
+
+    // values of a fixed width, at is where patch() overwrites them later without moving anything behind
+    JsonWriter& fixed(uint32_t value, size_t& at);
+    JsonWriter& fixed(float value, size_t& at);
+    static void patch(std::string& out, Format format, size_t at, uint32_t value);
+    static void patch(std::string& out, Format format, size_t at, float value);
+
+    // an empty string whose text is put in later by fill(), which returns how many bytes out grew by;
+    // the text is taken as is, it must not need escaping (e.g. base64)
+    JsonWriter& empty(size_t& at);
+    static size_t fill(std::string& out, Format format, size_t at, const std::string& text);
+
+    size_t size() const {
+        return out_.size();
+    }
+
+private:
+    void separate();
+    void append(const char* text, int length);
+    void quote(const char* value, size_t length);
+    void begin(bool object);
+    void end(bool object);
+    void integer(bool negative, uint64_t value);
+    void string(const char* value, size_t length);
+
+    std::string& out_;
+    Format format_;
+    int depth_;
+    uint32_t count_[JSON_WRITER_DEPTH];  // entries written at this level, keys of an object
+    size_t header_[JSON_WRITER_DEPTH];   // MessagePack, offset of the size of the container
+    bool keyed_;                         // a key was written, its value needs no comma
+};
+
+}  // namespace ma::node
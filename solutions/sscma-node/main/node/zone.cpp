@@ -0,0 +1,281 @@
+#include <algorithm>
+
+#include "zone.h"
+
+namespace ma::node {
+
+#define ZONE_GRID          16   // cells per side over 0..100
+#define ZONE_TRACK_TIMEOUT 30   // frames without an update before a track is forgotten
+#define ZONE_MAX_POINTS    64
+
+static int cell(float v) {
+    return std::min(std::max(static_cast<int>(v * ZONE_GRID / 100.0f), 0), ZONE_GRID - 1);
+}
+
+// > 0 when p is left of a -> b
+static float side(float ax, float ay, float bx, float by, float px, float py) {
+    return (bx - ax) * (py - ay) - (by - ay) * (px - ax);
+}
+
+ZoneCounter::ZoneCounter() : epoch_(0), frame_(0) {}
+
+ma_err_t ZoneCounter::parse(const json& zones, std::vector<Zone>& parsed) {
+    if (!zones.is_array()) {
+        return MA_EINVAL;
+    }
+
+    for (auto& item : zones) {
+        if (!item.is_object()) {
+            return MA_EINVAL;
+        }
+        Zone zone          = {};
+        zone.polygon       = item.contains("polygon");
+        const json& points = zone.polygon ? item["polygon"] : item.value("line", json());
+        if (!points.is_array() || points.size() % 2 != 0 || points.size() > ZONE_MAX_POINTS * 2) {
+            return MA_EINVAL;
+        }
+        if (zone.polygon ? points.size() < 6 : points.size() != 4) {
+            return MA_EINVAL;
+        }
+        for (size_t i = 0; i < points.size(); i += 2) {
+            if (!points[i].is_number() || !points[i + 1].is_number()) {
+                return MA_EINVAL;
+            }
+            zone.xs.push_back(points[i].get<float>());
+            zone.ys.push_back(points[i + 1].get<float>());
+        }
+        zone.name = item.value("name", "zone" + std::to_string(parsed.size()));
+        zone.x1   = *std::min_element(zone.xs.begin(), zone.xs.end());
+        zone.y1   = *std::min_element(zone.ys.begin(), zone.ys.end());
+        zone.x2   = *std::max_element(zone.xs.begin(), zone.xs.end());
+        zone.y2   = *std::max_element(zone.ys.begin(), zone.ys.end());
+        parsed.push_back(std::move(zone));
+    }
+
+    return MA_OK;
+}
+
+ma_err_t ZoneCounter::validate(const json& zones) {
+    std::vector<Zone> parsed;
+    return parse(zones, parsed);
+}
+
+ma_err_t ZoneCounter::configure(const json& zones) {
+    std::vector<Zone> parsed;
+    if (parse(zones, parsed) != MA_OK) {
+        return MA_EINVAL;
+    }
+
+    Guard guard(mutex_);
+    zones_.swap(parsed);
+    index();
+    clear();
+
+    return MA_OK;
+}
+
+bool ZoneCounter::empty() {
+    Guard guard(mutex_);
+    return zones_.empty();
+}
+
+void ZoneCounter::clear() {
+    Guard guard(mutex_);
+    for (auto& zone : zones_) {
+        zone.in     = 0;
+        zone.out    = 0;
+        zone.inside = 0;
+        std::fill(std::begin(zone.published), std::end(zone.published), -1);
+    }
+    tracks_.clear();
+    frame_ = 0;
+}
+
+void ZoneCounter::index() {
+    cells_.assign(ZONE_GRID * ZONE_GRID, std::vector<int32_t>());
+    for (size_t z = 0; z < zones_.size(); z++) {
+        const Zone& zone = zones_[z];
+        for (int cy = cell(zone.y1); cy <= cell(zone.y2); cy++) {
+            for (int cx = cell(zone.x1); cx <= cell(zone.x2); cx++) {
+                cells_[cy * ZONE_GRID + cx].push_back(z);
+            }
+        }
+    }
+    stamps_.assign(zones_.size(), 0);
+    epoch_ = 0;
+}
+
+void ZoneCounter::candidates(float x1, float y1, float x2, float y2) {
+    candidates_.clear();
+    if (++epoch_ == 0) {
+        std::fill(stamps_.begin(), stamps_.end(), 0);
+        epoch_ = 1;
+    }
+    for (int cy = cell(std::min(y1, y2)); cy <= cell(std::max(y1, y2)); cy++) {
+        for (int cx = cell(std::min(x1, x2)); cx <= cell(std::max(x1, x2)); cx++) {
+            for (auto z : cells_[cy * ZONE_GRID + cx]) {
+                if (stamps_[z] != epoch_) {
+                    stamps_[z] = epoch_;
+                    candidates_.push_back(z);
+                }
+            }
+        }
+    }
+}
+
+bool ZoneCounter::contains(const Zone& zone, float x, float y) const {
+    if (x < zone.x1 || x > zone.x2 || y < zone.y1 || y > zone.y2) {
+        return false;
+    }
+    // even-odd rule
+    bool inside    = false;
+    const size_t n = zone.xs.size();
+    for (size_t i = 0, j = n - 1; i < n; j = i++) {
+        if ((zone.ys[i] > y) != (zone.ys[j] > y) && x < (zone.xs[j] - zone.xs[i]) * (y - zone.ys[i]) / (zone.ys[j] - zone.ys[i]) + zone.xs[i]) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+void ZoneCounter::enter(Track& track, float x, float y, ma_tick_t now) {
+    candidates(x, y, x, y);
+    for (auto z : candidates_) {
+        Zone& zone = zones_[z];
+        if (zone.polygon && contains(zone, x, y)) {
+            zone.in++;
+            zone.inside++;
+            track.visits.push_back({z, now});
+        }
+    }
+}
+
+void ZoneCounter::step(Track& track, float x, float y, ma_tick_t now) {
+    candidates(track.x, track.y, x, y);
+    for (auto z : candidates_) {
+        Zone& zone = zones_[z];
+        if (!zone.polygon) {
+            float from = side(zone.xs[0], zone.ys[0], zone.xs[1], zone.ys[1], track.x, track.y);
+            float to   = side(zone.xs[0], zone.ys[0], zone.xs[1], zone.ys[1], x, y);
+            if ((from > 0) == (to > 0)) {
+                continue;
+            }
+            // the step has to cross the wire itself, not its extension
+            float a = side(track.x, track.y, x, y, zone.xs[0], zone.ys[0]);
+            float b = side(track.x, track.y, x, y, zone.xs[1], zone.ys[1]);
+            if (a * b > 0) {
+                continue;
+            }
+            if (to > 0) {
+                zone.out++;
+            } else {
+                zone.in++;
+            }
+            continue;
+        }
+
+        auto visit      = std::find_if(track.visits.begin(), track.visits.end(), [z](const Visit& v) { return v.zone == z; });
+        bool now_inside = contains(zone, x, y);
+        if (now_inside && visit == track.visits.end()) {
+            zone.in++;
+            zone.inside++;
+            track.visits.push_back({z, now});
+        } else if (!now_inside && visit != track.visits.end()) {
+            zone.out++;
+            zone.inside--;
+            track.visits.erase(visit);
+        }
+    }
+
+    // a polygon the step did not touch at all is left as well
+    for (auto visit = track.visits.begin(); visit != track.visits.end();) {
+        if (stamps_[visit->zone] != epoch_) {
+            zones_[visit->zone].out++;
+            zones_[visit->zone].inside--;
+            visit = track.visits.erase(visit);
+        } else {
+            ++visit;
+        }
+    }
+
+    track.x = x;
+    track.y = y;
+}
+
+void ZoneCounter::update(const std::vector<int>& tracks, const std::vector<float>& xs, const std::vector<float>& ys, ma_tick_t now) {
+    Guard guard(mutex_);
+    if (zones_.empty()) {
+        return;
+    }
+
+    frame_++;
+    for (size_t i = 0; i < tracks.size(); i++) {
+        if (tracks[i] < 0) {
+            continue;
+        }
+        auto it = tracks_.find(tracks[i]);
+        if (it == tracks_.end()) {
+            Track& track = tracks_[tracks[i]];
+            track.x      = xs[i];
+            track.y      = ys[i];
+            track.seen   = frame_;
+            enter(track, xs[i], ys[i], now);
+            continue;
+        }
+        step(it->second, xs[i], ys[i], now);
+        it->second.seen = frame_;
+    }
+
+    // a track the tracker gave up on leaves the occupancy without counting out, nobody saw it leave
+    for (auto it = tracks_.begin(); it != tracks_.end();) {
+        if (frame_ - it->second.seen > ZONE_TRACK_TIMEOUT) {
+            for (auto& visit : it->second.visits) {
+                zones_[visit.zone].inside--;
+            }
+            it = tracks_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool ZoneCounter::changed() {
+    Guard guard(mutex_);
+    for (auto& zone : zones_) {
+        if (zone.published[0] != zone.in || zone.published[1] != zone.out || zone.published[2] != zone.inside) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ZoneCounter::write(JsonWriter& writer, bool all, ma_tick_t now) {
+    Guard guard(mutex_);
+
+    dwell_.assign(zones_.size(), 0);
+    for (auto& track : tracks_) {
+        for (auto& visit : track.second.visits) {
+            dwell_[visit.zone] = std::max(dwell_[visit.zone], now - visit.since);
+        }
+    }
+
+    writer.beginArray();
+    for (size_t z = 0; z < zones_.size(); z++) {
+        Zone& zone   = zones_[z];
+        bool changed = zone.published[0] != zone.in || zone.published[1] != zone.out || zone.published[2] != zone.inside;
+        if (!changed && !all) {
+            continue;
+        }
+        writer.beginObject().key("name").value(zone.name).key("in").value(zone.in).key("out").value(zone.out);
+        if (zone.polygon) {
+            writer.key("inside").value(zone.inside).key("dwell").value(Tick::toMilliseconds(dwell_[z]));
+        }
+        writer.endObject();
+        zone.published[0] = zone.in;
+        zone.published[1] = zone.out;
+        zone.published[2] = zone.inside;
+    }
+    writer.endArray();
+}
+
+}  // namespace ma::node
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "core/ma_core.h"
+#include "porting/ma_osal.h"
+
+#include "node.h"
+#include "writer.h"
+
+namespace ma::node {
+
+// Tripwires and occupancy polygons evaluated on the track stream of a model node.
+// Zones are registered in a coarse grid over the 0..100 percent space, a track only tests the zones
+// of the cells its last step touched, so the cost per frame follows the tracks and not the zone count.
+// Crossing a line from the left of its a -> b direction to the right counts "in", back counts "out";
+// a polygon counts "in" and "out" when a track enters or leaves it and keeps the current occupancy
+// ("inside") and the longest running stay ("dwell", ms).
+class ZoneCounter {
+public:
+    ZoneCounter();
+    ~ZoneCounter() = default;
+
+    // [{"name": "door", "line": [x1, y1, x2, y2]}, {"name": "queue", "polygon": [x1, y1, x2, y2, x3, y3, ...]}, ...]
+    // in percent of the published space, an empty array removes all zones, counts restart from zero
+    ma_err_t configure(const json& zones);
+    // the checks of configure() alone
+    static ma_err_t validate(const json& zones);
+    bool empty();
+
+    // counts to zero, tracks forgotten, the next write() reports every zone
+    void clear();
+
+    // one point per box, in percent of the published space, tracks[i] < 0 are ignored
+    void update(const std::vector<int>& tracks, const std::vector<float>& xs, const std::vector<float>& ys, ma_tick_t now);
+
+    // counts moved since the last write()
+    bool changed();
+
+    // array of the zones whose counts changed since the last call, or of all of them
+    void write(JsonWriter& writer, bool all, ma_tick_t now);
+
+private:
+    struct Zone {
+        std::string name;
+        bool polygon;
+        std::vector<float> xs;
+        std::vector<float> ys;
+        float x1;  // bounding box
+        float y1;
+        float x2;
+        float y2;
+        int32_t in;
+        int32_t out;
+        int32_t inside;
+        int32_t published[3];  // in, out, inside as last reported, -1 before the first report
+    };
+
+    struct Visit {
+        int32_t zone;
+        ma_tick_t since;
+    };
+
+    struct Track {
+        float x;
+        float y;
+        uint32_t seen;  // frame of the last update
+        std::vector<Visit> visits;
+    };
+
+    static ma_err_t parse(const json& zones, std::vector<Zone>& parsed);
+    void index();
+    void candidates(float x1, float y1, float x2, float y2);
+    bool contains(const Zone& zone, float x, float y) const;
+    void step(Track& track, float x, float y, ma_tick_t now);
+    void enter(Track& track, float x, float y, ma_tick_t now);
+
+    Mutex mutex_;
+    std::vector<Zone> zones_;
+    std::vector<std::vector<int32_t>> cells_;  // zones per grid cell
+    std::vector<uint32_t> stamps_;             // per zone, == epoch_ when already a candidate of this query
+    std::vector<int32_t> candidates_;
+    std::vector<ma_tick_t> dwell_;             // longest running stay per zone, write() only
+    uint32_t epoch_;
+    uint32_t frame_;
+    std::unordered_map<int, Track> tracks_;
+};
+
+}  // namespace ma::node